@@ -0,0 +1,17 @@
+# Locate the EGL library, used for the headless (windowless) rendering mode
+#
+# This module defines the following variables:
+#
+# EGL_LIBRARY the name of the library;
+# EGL_INCLUDE_DIR where to find EGL/egl.h.
+# EGL_FOUND true if both the EGL_LIBRARY and EGL_INCLUDE_DIR have been found.
+
+FIND_PATH(EGL_INCLUDE_DIR "EGL/egl.h"
+PATHS "/usr/include" "/usr/local/include" )
+
+FIND_LIBRARY(EGL_LIBRARY NAMES EGL
+PATHS "/usr/lib" "/usr/local/lib" )
+
+INCLUDE(FindPackageHandleStandardArgs)
+FIND_PACKAGE_HANDLE_STANDARD_ARGS(EGL DEFAULT_MSG
+EGL_LIBRARY EGL_INCLUDE_DIR)
@@ -0,0 +1,338 @@
+#ifndef BC_ENCODER_H
+#define BC_ENCODER_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Block compression of 8 bit RGBA images for the offline TextureBaker: BC1 (RGB, 4 bits per pixel), BC3 (RGBA,
+// 8 bits per pixel) and BC7 mode 6 (RGBA, 8 bits per pixel, the best of the three on smooth gradients).
+//
+// Every 4x4 block gets its endpoints from the principal axis of its colors; the endpoints are then fitted by
+// least squares to the chosen indices once and the better of both encodings is kept. That is a small fraction
+// of what an exhaustive encoder searches, but quick on a whole texture set and close on planet maps.
+enum BlockFormat {
+    BLOCK_BC1,
+    BLOCK_BC3,
+    BLOCK_BC7
+};
+
+inline unsigned int blockBytes(BlockFormat format)
+{
+    return format == BLOCK_BC1 ? 8 : 16;
+}
+
+namespace bc
+{
+    typedef float Block[16][4]; // RGBA of the 16 pixels, row by row
+
+    // mean and unit principal axis of the first channels components, axis 0 for a flat block
+    inline void principalAxis(const Block& block, int channels, float* mean, float* axis)
+    {
+        for (int c = 0; c < 4; c++)
+            mean[c] = axis[c] = 0.0f;
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < channels; c++)
+                mean[c] += block[i][c] / 16.0f;
+        float covariance[4][4] = { { 0.0f } };
+        for (int i = 0; i < 16; i++)
+            for (int c = 0; c < channels; c++)
+                for (int d = 0; d < channels; d++)
+                    covariance[c][d] += (block[i][c] - mean[c]) * (block[i][d] - mean[d]);
+        // power iteration, starting from the row of the largest variance
+        int start = 0;
+        for (int c = 1; c < channels; c++)
+            if (covariance[c][c] > covariance[start][start])
+                start = c;
+        float vector[4];
+        for (int c = 0; c < 4; c++)
+            vector[c] = c < channels ? covariance[start][c] : 0.0f;
+        for (int iteration = 0; iteration < 8; iteration++)
+        {
+            float next[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+            float length = 0.0f;
+            for (int c = 0; c < channels; c++)
+            {
+                for (int d = 0; d < channels; d++)
+                    next[c] += covariance[c][d] * vector[d];
+                length += next[c] * next[c];
+            }
+            length = std::sqrt(length);
+            if (length < 1e-6f)
+                return;
+            for (int c = 0; c < channels; c++)
+                vector[c] = next[c] / length;
+        }
+        for (int c = 0; c < channels; c++)
+            axis[c] = vector[c];
+    }
+
+    // ends of the block's extent along the axis
+    inline void axisEndpoints(const Block& block, int channels, float* first, float* second)
+    {
+        float mean[4], axis[4];
+        principalAxis(block, channels, mean, axis);
+        float low = 0.0f, high = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float projection = 0.0f;
+            for (int c = 0; c < channels; c++)
+                projection += (block[i][c] - mean[c]) * axis[c];
+            low = std::min(low, projection);
+            high = std::max(high, projection);
+        }
+        for (int c = 0; c < channels; c++)
+        {
+            first[c] = mean[c] + axis[c] * high;
+            second[c] = mean[c] + axis[c] * low;
+        }
+    }
+
+    // endpoints a and b minimizing the squared error of (1 - t) a + t b to each pixel, for given weights t
+    inline bool fitEndpoints(const Block& block, const float* t, int channels, float* a, float* b)
+    {
+        float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+        float ax[4] = { 0.0f, 0.0f, 0.0f, 0.0f }, bx[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+        for (int i = 0; i < 16; i++)
+        {
+            float s = 1.0f - t[i];
+            aa += s * s;
+            ab += s * t[i];
+            bb += t[i] * t[i];
+            for (int c = 0; c < channels; c++)
+            {
+                ax[c] += s * block[i][c];
+                bx[c] += t[i] * block[i][c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (std::fabs(determinant) < 1e-4f)
+            return false;
+        for (int c = 0; c < channels; c++)
+        {
+            a[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+            b[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+        }
+        return true;
+    }
+
+    // nearest palette entry of every pixel, returns the summed squared error
+    inline float chooseIndices(const Block& block, const int (*palette)[4], int entries, int channels, int* indices)
+    {
+        float total = 0.0f;
+        for (int i = 0; i < 16; i++)
+        {
+            float best = 1e30f;
+            for (int p = 0; p < entries; p++)
+            {
+                float error = 0.0f;
+                for (int c = 0; c < channels; c++)
+                {
+                    float difference = block[i][c] - palette[p][c];
+                    error += difference * difference;
+                }
+                if (error < best)
+                {
+                    best = error;
+                    indices[i] = p;
+                }
+            }
+            total += best;
+        }
+        return total;
+    }
+
+    // writes value into the zeroed block, least significant bit first
+    inline void putBits(unsigned char* out, unsigned int& position, unsigned int value, unsigned int bits)
+    {
+        for (unsigned int i = 0; i < bits; i++, position++)
+            if ((value >> i) & 1)
+                out[position / 8] |= 1 << (position % 8);
+    }
+
+    inline uint16_t pack565(const float* color)
+    {
+        int r = std::min(std::max((int)(color[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+        int g = std::min(std::max((int)(color[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+        int b = std::min(std::max((int)(color[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    inline void unpack565(uint16_t packed, int* color)
+    {
+        int r = packed >> 11, g = (packed >> 5) & 63, b = packed & 31;
+        color[0] = (r << 3) | (r >> 2);
+        color[1] = (g << 2) | (g >> 4);
+        color[2] = (b << 3) | (b >> 2);
+        color[3] = 255;
+    }
+
+    // 8 byte color block of BC1 and BC3, always in four color mode
+    inline void encodeColor(const Block& block, unsigned char* out)
+    {
+        static const float WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f }; // of the second endpoint
+        float first[4], second[4];
+        axisEndpoints(block, 3, first, second);
+        float bestError = 1e30f;
+        for (int iteration = 0; iteration < 2; iteration++)
+        {
+            uint16_t c0 = pack565(first), c1 = pack565(second);
+            if (c0 < c1)
+                std::swap(c0, c1);
+            int palette[4][4];
+            unpack565(c0, palette[0]);
+            unpack565(c1, palette[1]);
+            for (int c = 0; c < 3; c++)
+            {
+                palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+                palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+            }
+            int indices[16];
+            float error = chooseIndices(block, palette, 4, 3, indices);
+            if (error < bestError)
+            {
+                bestError = error;
+                std::memset(out, 0, 8);
+                unsigned int position = 0;
+                putBits(out, position, c0, 16);
+                putBits(out, position, c1, 16);
+                for (int i = 0; i < 16; i++)
+                    putBits(out, position, indices[i], 2);
+            }
+            float t[16];
+            for (int i = 0; i < 16; i++)
+                t[i] = WEIGHTS[indices[i]];
+            float fitted[2][4];
+            if (!fitEndpoints(block, t, 3, fitted[0], fitted[1]))
+                break;
+            std::memcpy(first, fitted[0], sizeof(first));
+            std::memcpy(second, fitted[1], sizeof(second));
+        }
+    }
+
+    // 8 byte alpha block of BC3, eight value mode between the block's extremes
+    inline void encodeAlpha(const Block& block, unsigned char* out)
+    {
+        int high = 0, low = 255;
+        for (int i = 0; i < 16; i++)
+        {
+            high = std::max(high, (int)block[i][3]);
+            low = std::min(low, (int)block[i][3]);
+        }
+        int palette[8][4];
+        palette[0][0] = high;
+        palette[1][0] = low;
+        for (int p = 1; p < 7; p++)
+            palette[p + 1][0] = ((7 - p) * high + p * low) / 7;
+        Block alpha;
+        for (int i = 0; i < 16; i++)
+            alpha[i][0] = block[i][3];
+        int indices[16];
+        chooseIndices(alpha, palette, high == low ? 1 : 8, 1, indices);
+        std::memset(out, 0, 8);
+        unsigned int position = 0;
+        putBits(out, position, high, 8);
+        putBits(out, position, low, 8);
+        for (int i = 0; i < 16; i++)
+            putBits(out, position, indices[i], 3);
+    }
+
+    // 16 byte BC7 block in mode 6: one subset, 7 bit RGBA endpoints with a shared low bit each, 4 bit indices
+    inline void encodeBC7Mode6(const Block& block, unsigned char* out)
+    {
+        static const int WEIGHTS[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+        float endpoints[2][4];
+        axisEndpoints(block, 4, endpoints[0], endpoints[1]);
+        float bestError = 1e30f;
+        for (int iteration = 0; iteration < 2; iteration++)
+        {
+            // quantize each endpoint with the p-bit that reconstructs it best
+            int quantized[2][4], pbit[2], reconstructed[2][4];
+            for (int e = 0; e < 2; e++)
+            {
+                float bestEndpointError = 1e30f;
+                for (int p = 0; p < 2; p++)
+                {
+                    int q[4];
+                    float error = 0.0f;
+                    for (int c = 0; c < 4; c++)
+                    {
+                        q[c] = std::min(std::max((int)std::floor((endpoints[e][c] - p) / 2.0f + 0.5f), 0), 127);
+                        float difference = endpoints[e][c] - (q[c] * 2 + p);
+                        error += difference * difference;
+                    }
+                    if (error < bestEndpointError)
+                    {
+                        bestEndpointError = error;
+                        pbit[e] = p;
+                        std::memcpy(quantized[e], q, sizeof(q));
+                    }
+                }
+                for (int c = 0; c < 4; c++)
+                    reconstructed[e][c] = quantized[e][c] * 2 + pbit[e];
+            }
+            int palette[16][4];
+            for (int p = 0; p < 16; p++)
+                for (int c = 0; c < 4; c++)
+                    palette[p][c] = ((64 - WEIGHTS[p]) * reconstructed[0][c] + WEIGHTS[p] * reconstructed[1][c] + 32) >> 6;
+            int indices[16];
+            float error = chooseIndices(block, palette, 16, 4, indices);
+            if (error < bestError)
+            {
+                bestError = error;
+                // the first index has an implicit zero high bit: swap the endpoints if it is set
+                bool swap = indices[0] >= 8;
+                int first = swap ? 1 : 0;
+                std::memset(out, 0, 16);
+                unsigned int position = 0;
+                putBits(out, position, 1 << 6, 7);
+                for (int c = 0; c < 4; c++)
+                {
+                    putBits(out, position, quantized[first][c], 7);
+                    putBits(out, position, quantized[1 - first][c], 7);
+                }
+                putBits(out, position, pbit[first], 1);
+                putBits(out, position, pbit[1 - first], 1);
+                for (int i = 0; i < 16; i++)
+                    putBits(out, position, swap ? 15 - indices[i] : indices[i], i == 0 ? 3 : 4);
+            }
+            float t[16];
+            for (int i = 0; i < 16; i++)
+                t[i] = WEIGHTS[indices[i]] / 64.0f;
+            if (!fitEndpoints(block, t, 4, endpoints[0], endpoints[1]))
+                break;
+        }
+    }
+}
+
+// compresses an RGBA image; blocks that reach past the right or bottom edge repeat the edge pixels
+inline void compressImage(BlockFormat format, const unsigned char* rgba, int width, int height, std::vector<unsigned char>& out)
+{
+    int blocksWide = (width + 3) / 4, blocksHigh = (height + 3) / 4;
+    unsigned int bytes = blockBytes(format);
+    out.assign((size_t)blocksWide * blocksHigh * bytes, 0);
+    bc::Block block;
+    for (int by = 0; by < blocksHigh; by++)
+        for (int bx = 0; bx < blocksWide; bx++)
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                int x = std::min(bx * 4 + i % 4, width - 1), y = std::min(by * 4 + i / 4, height - 1);
+                for (int c = 0; c < 4; c++)
+                    block[i][c] = rgba[((size_t)y * width + x) * 4 + c];
+            }
+            unsigned char* destination = &out[((size_t)by * blocksWide + bx) * bytes];
+            if (format == BLOCK_BC1)
+                bc::encodeColor(block, destination);
+            else if (format == BLOCK_BC3)
+            {
+                bc::encodeAlpha(block, destination);
+                bc::encodeColor(block, destination + 8);
+            }
+            else
+                bc::encodeBC7Mode6(block, destination);
+        }
+}
+#endif
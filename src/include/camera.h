@@ -112,6 +112,15 @@ public:
             Zoom = 45.0f;
     }
 
+    // turns the camera towards a point, used by scripted camera paths instead of mouse input
+    void LookAt(const glm::vec3& target)
+    {
+        glm::vec3 direction = glm::normalize(target - Position);
+        Yaw = glm::degrees(atan2(direction.z, direction.x));
+        Pitch = glm::degrees(asin(glm::clamp(direction.y, -0.999f, 0.999f)));
+        updateCameraVectors();
+    }
+
 private:
     // calculates the front vector from the Camera's (updated) Euler Angles
     void updateCameraVectors()
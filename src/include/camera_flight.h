@@ -0,0 +1,180 @@
+#ifndef CAMERA_FLIGHT_H
+#define CAMERA_FLIGHT_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "orbit.h"
+
+// Fixed camera path for the --benchmark mode: a warm-up hold, a tour around the whole system, a close flyby
+// of every planet and a zoom out past Neptune. The path is a pure function of the frame number and the
+// simulation time, and sets the Camera directly, so every run renders the same frames.
+//
+// record() collects the frame time of every frame under its segment; writeResults() writes per-segment and
+// overall mean/p50/p95/p99/max as JSON. The warm-up frames (shader compilation, first uploads) are reported
+// but left out of the overall numbers.
+class CameraFlight
+{
+public:
+    enum SegmentKind {
+        SEGMENT_HOLD,
+        SEGMENT_ORBIT,
+        SEGMENT_FLYBY,
+        SEGMENT_ZOOM_OUT
+    };
+
+    struct Segment {
+        std::string name;
+        SegmentKind kind;
+        unsigned int frames;
+        unsigned int body; // flybys only
+    };
+
+    // frame counts at 60 frames per second of simulated time
+    static const unsigned int WARMUP_FRAMES = 60;
+    static const unsigned int ORBIT_FRAMES = 600;
+    static const unsigned int FLYBY_FRAMES = 240;
+    static const unsigned int ZOOM_OUT_FRAMES = 480;
+
+    CameraFlight()
+    {
+        addSegment("warmup", SEGMENT_HOLD, WARMUP_FRAMES, 0);
+        addSegment("orbit_tour", SEGMENT_ORBIT, ORBIT_FRAMES, 0);
+        for (unsigned int i = MERCURY; i < BODY_COUNT; i++)
+            addSegment(std::string("flyby_") + BODIES[i].name, SEGMENT_FLYBY, FLYBY_FRAMES, i);
+        addSegment("zoom_out", SEGMENT_ZOOM_OUT, ZOOM_OUT_FRAMES, 0);
+    }
+
+    unsigned int frameCount() const
+    {
+        return segmentStart.back();
+    }
+
+    // places and aims the camera for the given frame
+    void apply(unsigned int frame, float simulationTime, Camera& camera) const
+    {
+        unsigned int index = segmentOf(frame);
+        const Segment& segment = segments[index];
+        float t = (float)(frame - segmentStart[index]) / std::max(segment.frames - 1, 1u);
+        const float PI = 3.14159265359f;
+        glm::vec3 target(0.0f);
+        switch (segment.kind)
+        {
+        case SEGMENT_HOLD:
+            camera.Position = glm::vec3(0.0f, 25.0f, 45.0f);
+            break;
+        case SEGMENT_ORBIT:
+        {
+            // one revolution around the sun, outside Neptune's orbit and a little above the plane
+            float angle = 2.0f * PI * t;
+            camera.Position = glm::vec3(55.0f * cos(angle), 18.0f, 55.0f * sin(angle));
+            break;
+        }
+        case SEGMENT_FLYBY:
+        {
+            // swing past the planet on its sunlit side: far, closest at mid-segment, far again
+            const Body& body = BODIES[segment.body];
+            target = body.position(simulationTime);
+            glm::vec3 radial = glm::normalize(target);
+            glm::vec3 tangent = glm::vec3(-radial.z, 0.0f, radial.x);
+            float angle = -PI / 3.0f + PI * t;
+            float distance = body.scale * (2.5f + 10.0f * (2.0f * t - 1.0f) * (2.0f * t - 1.0f));
+            camera.Position = target + distance * (cos(angle) * -radial + sin(angle) * tangent) + glm::vec3(0.0f, 0.3f * distance, 0.0f);
+            break;
+        }
+        case SEGMENT_ZOOM_OUT:
+        {
+            // exponential pull back from just outside the sun to far beyond Neptune
+            float distance = 8.0f * pow(600.0f / 8.0f, t);
+            camera.Position = distance * glm::normalize(glm::vec3(0.0f, 0.4f, 1.0f));
+            break;
+        }
+        }
+        camera.LookAt(target);
+    }
+
+    void record(unsigned int frame, float milliseconds)
+    {
+        times[segmentOf(frame)].push_back(milliseconds);
+    }
+
+    // path "-" writes to stdout
+    bool writeResults(const std::string& path, const char* renderer, unsigned int width, unsigned int height) const
+    {
+        FILE* file = path == "-" ? stdout : std::fopen(path.c_str(), "w");
+        if (!file)
+        {
+            std::printf("ERROR::BENCHMARK::FILE_NOT_SUCCESFULLY_WRITTEN: %s\n", path.c_str());
+            return false;
+        }
+        std::vector<float> overall;
+        for (unsigned int i = 0; i < segments.size(); i++)
+            if (segments[i].kind != SEGMENT_HOLD)
+                overall.insert(overall.end(), times[i].begin(), times[i].end());
+        std::fprintf(file, "{\n  \"renderer\": \"%s\",\n  \"width\": %u,\n  \"height\": %u,\n  \"frames\": %u,\n  \"overall\": ",
+                     renderer, width, height, frameCount());
+        writeStatistics(file, overall);
+        std::fprintf(file, ",\n  \"segments\": [\n");
+        for (unsigned int i = 0; i < segments.size(); i++)
+        {
+            std::fprintf(file, "    { \"name\": \"%s\", \"statistics\": ", segments[i].name.c_str());
+            writeStatistics(file, times[i]);
+            std::fprintf(file, " }%s\n", i + 1 < segments.size() ? "," : "");
+        }
+        std::fprintf(file, "  ]\n}\n");
+        if (file != stdout)
+            std::fclose(file);
+        return true;
+    }
+
+private:
+    std::vector<Segment> segments;
+    std::vector<unsigned int> segmentStart; // first frame of each segment, then the total frame count
+    std::vector<std::vector<float> > times; // frame times in ms per segment
+
+    void addSegment(const std::string& name, SegmentKind kind, unsigned int frames, unsigned int body)
+    {
+        Segment segment = { name, kind, frames, body };
+        if (segmentStart.empty())
+            segmentStart.push_back(0);
+        segments.push_back(segment);
+        segmentStart.push_back(segmentStart.back() + frames);
+        times.push_back(std::vector<float>());
+        times.back().reserve(frames);
+    }
+
+    unsigned int segmentOf(unsigned int frame) const
+    {
+        unsigned int index = std::upper_bound(segmentStart.begin(), segmentStart.end(), frame) - segmentStart.begin() - 1;
+        return std::min(index, (unsigned int)segments.size() - 1);
+    }
+
+    static void writeStatistics(FILE* file, std::vector<float> values)
+    {
+        if (values.empty())
+        {
+            std::fprintf(file, "{ \"frames\": 0 }");
+            return;
+        }
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (size_t i = 0; i < values.size(); i++)
+            sum += values[i];
+        double mean = sum / values.size();
+        std::fprintf(file, "{ \"frames\": %u, \"mean_ms\": %.4f, \"p50_ms\": %.4f, \"p95_ms\": %.4f, \"p99_ms\": %.4f, \"max_ms\": %.4f, \"fps\": %.2f }",
+                     (unsigned int)values.size(), mean, percentile(values, 0.50), percentile(values, 0.95),
+                     percentile(values, 0.99), values.back(), 1000.0 / mean);
+    }
+
+    static double percentile(const std::vector<float>& sorted, double quantile)
+    {
+        return sorted[(size_t)(quantile * (sorted.size() - 1) + 0.5)];
+    }
+};
+#endif
@@ -0,0 +1,382 @@
+#ifndef EPHEMERIS_SERVER_H
+#define EPHEMERIS_SERVER_H
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "orbit.h"
+
+// Answers "where is body X at times T[]" over a Unix domain socket, using the same BODIES table
+// the render loop draws from.
+//
+// Protocol (native byte order, clients may pipeline any number of requests):
+//   request:  EphemerisRequest, followed by count f32 simulation times (days)
+//   response: EphemerisResponse, followed by count * 3 f32 positions (x, y, z per time)
+// Responses on one connection come back in request order.
+//
+// The server is a single poll() loop. Every request that arrived during one wake-up, from any
+// connection, forms a batch: times are gathered per body into one contiguous array and evaluated
+// with Body::positions, then scattered back into the per-connection responses.
+//
+// A connection stops being read while more than EPHEMERIS_MAX_PENDING_BYTES of its responses are unsent, and
+// is closed if it stays over that for EPHEMERIS_STALL_SECONDS; a client that pipelines requests without
+// reading the answers cannot grow the server without bound.
+//
+// A stale socket file from a crashed run is removed before bind. serve() returns on SIGINT or SIGTERM so
+// that the destructor removes the socket file of this run too.
+const uint32_t EPHEMERIS_MAX_TIMES = 65536;
+const size_t EPHEMERIS_MAX_PENDING_BYTES = 16 << 20;
+const double EPHEMERIS_STALL_SECONDS = 10.0;
+
+enum EphemerisStatus {
+    EPHEMERIS_OK = 0,
+    EPHEMERIS_UNKNOWN_BODY = 1
+};
+
+struct EphemerisRequest {
+    uint32_t id;
+    uint32_t body;
+    uint32_t count;
+};
+
+struct EphemerisResponse {
+    uint32_t id;
+    uint32_t status;
+    uint32_t count;
+};
+
+// set by the SIGINT/SIGTERM handler serve() installs; a template so the header needs no .cpp to define it
+template<typename Unused = void>
+struct EphemerisSignal {
+    static volatile sig_atomic_t stop;
+
+    static void handle(int)
+    {
+        stop = 1;
+    }
+};
+template<typename Unused> volatile sig_atomic_t EphemerisSignal<Unused>::stop = 0;
+
+class EphemerisServer
+{
+public:
+    EphemerisServer(const std::string& socketPath) : path(socketPath), listenFd(-1), batches(0), queries(0)
+    {
+        sockaddr_un address;
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            std::cout << "ERROR::EPHEMERIS::SOCKET_PATH_TOO_LONG: " << path << std::endl;
+            return;
+        }
+        strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(path.c_str()); // remove a stale socket left behind by a previous run
+        if (listenFd < 0 || bind(listenFd, (sockaddr*)&address, sizeof(address)) < 0 || listen(listenFd, 64) < 0)
+        {
+            std::cout << "ERROR::EPHEMERIS::SOCKET_SETUP_FAILED: " << strerror(errno) << std::endl;
+            if (listenFd >= 0)
+                close(listenFd);
+            listenFd = -1;
+            return;
+        }
+        setNonBlocking(listenFd);
+    }
+
+    ~EphemerisServer()
+    {
+        for (unsigned int i = 0; i < connections.size(); i++)
+            close(connections[i].fd);
+        if (listenFd >= 0)
+        {
+            close(listenFd);
+            unlink(path.c_str());
+        }
+    }
+
+    bool isOpen() const
+    {
+        return listenFd >= 0;
+    }
+
+    // serves requests until SIGINT or SIGTERM
+    void serve()
+    {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = EphemerisSignal<>::handle;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, NULL); // no SA_RESTART: the signal interrupts poll()
+        sigaction(SIGTERM, &action, NULL);
+        std::cout << "EPHEMERIS: listening on " << path << std::endl;
+        // the timeout bounds the wait for a signal that lands between the test and poll()
+        while (isOpen() && !EphemerisSignal<>::stop)
+            poll(1000);
+        std::cout << "EPHEMERIS: stopped after " << batches << " batches, " << queries << " queries" << std::endl;
+    }
+
+    // waits up to timeoutMs for activity, then handles everything that arrived as one batch
+    void poll(int timeoutMs)
+    {
+        pollFds.resize(connections.size() + 1);
+        pollFds[0].fd = listenFd;
+        pollFds[0].events = POLLIN;
+        for (unsigned int i = 0; i < connections.size(); i++)
+        {
+            pollFds[i + 1].fd = connections[i].fd;
+            // over the cap only wait until it can take more output
+            pollFds[i + 1].events = (overCap(connections[i]) ? 0 : POLLIN) | (connections[i].out.size() > connections[i].outStart ? POLLOUT : 0);
+        }
+        // a timeout still goes through the steps below so that stalled connections get closed
+        if (::poll(&pollFds[0], pollFds.size(), timeoutMs) < 0)
+            return;
+
+        // 1. read and parse everything available into the batch
+        for (unsigned int i = 0; i < connections.size(); i++)
+        {
+            if (!connections[i].closed && !overCap(connections[i]) && (pollFds[i + 1].revents & (POLLIN | POLLHUP | POLLERR)))
+                receive(i);
+        }
+        // 2. evaluate the whole batch, one vectorized pass per body
+        evaluateBatch();
+        // 3. flush responses; drop connections that closed or misbehaved
+        for (unsigned int i = 0; i < connections.size(); i++)
+            send(connections[i]);
+        closeStalled();
+        for (unsigned int i = connections.size(); i-- > 0;)
+        {
+            if (connections[i].closed && connections[i].out.size() == connections[i].outStart)
+            {
+                close(connections[i].fd);
+                connections.erase(connections.begin() + i);
+            }
+        }
+        if (pollFds[0].revents & POLLIN)
+            accept();
+    }
+
+    unsigned long batchCount() const
+    {
+        return batches;
+    }
+
+    unsigned long queryCount() const
+    {
+        return queries;
+    }
+
+private:
+    struct Connection {
+        int fd;
+        bool closed;
+        std::vector<char> in;
+        std::vector<char> out;
+        size_t outStart;
+        bool over; // more than EPHEMERIS_MAX_PENDING_BYTES unsent
+        std::chrono::steady_clock::time_point overSince;
+    };
+
+    // a parsed request waiting for its batch to be evaluated
+    struct Pending {
+        unsigned int connection;
+        EphemerisRequest request;
+        uint32_t offset; // start of this request's times in bodyTimes[request.body]
+    };
+
+    std::string path;
+    int listenFd;
+    unsigned long batches;
+    unsigned long queries;
+    std::vector<Connection> connections;
+    std::vector<pollfd> pollFds;
+    std::vector<Pending> pending;
+    std::vector<float> bodyTimes[BODY_COUNT];
+    std::vector<float> bodyX[BODY_COUNT], bodyY[BODY_COUNT], bodyZ[BODY_COUNT];
+
+    static void setNonBlocking(int fd)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    static bool overCap(const Connection& connection)
+    {
+        return connection.out.size() - connection.outStart > EPHEMERIS_MAX_PENDING_BYTES;
+    }
+
+    // drops the output of connections that have not read their responses for EPHEMERIS_STALL_SECONDS
+    void closeStalled()
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < connections.size(); i++)
+        {
+            Connection& connection = connections[i];
+            if (!overCap(connection))
+                connection.over = false;
+            else if (!connection.over)
+            {
+                connection.over = true;
+                connection.overSince = now;
+            }
+            else if (std::chrono::duration<double>(now - connection.overSince).count() > EPHEMERIS_STALL_SECONDS)
+            {
+                std::cout << "ERROR::EPHEMERIS::CLIENT_NOT_READING: " << connection.out.size() - connection.outStart << " bytes unsent" << std::endl;
+                connection.closed = true;
+                connection.out.clear();
+                connection.outStart = 0;
+            }
+        }
+    }
+
+    void accept()
+    {
+        int fd;
+        while ((fd = ::accept(listenFd, NULL, NULL)) >= 0)
+        {
+            setNonBlocking(fd);
+            Connection connection;
+            connection.fd = fd;
+            connection.closed = false;
+            connection.outStart = 0;
+            connection.over = false;
+            connections.push_back(connection);
+        }
+    }
+
+    void receive(unsigned int index)
+    {
+        Connection& connection = connections[index];
+        char buffer[65536];
+        // read no more than a cap's worth of responses at three floats per time, the rest waits in the socket
+        while (connection.in.size() < EPHEMERIS_MAX_PENDING_BYTES / 3)
+        {
+            ssize_t n = read(connection.fd, buffer, sizeof(buffer));
+            if (n > 0)
+                connection.in.insert(connection.in.end(), buffer, buffer + n);
+            else if (n < 0 && errno == EINTR)
+                continue;
+            else
+            {
+                if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                    connection.closed = true;
+                break;
+            }
+        }
+
+        // parse every complete request in the input buffer
+        size_t position = 0;
+        while (connection.in.size() - position >= sizeof(EphemerisRequest))
+        {
+            Pending request;
+            memcpy(&request.request, &connection.in[position], sizeof(EphemerisRequest));
+            uint32_t count = request.request.count;
+            if (count > EPHEMERIS_MAX_TIMES)
+            {
+                std::cout << "ERROR::EPHEMERIS::REQUEST_TOO_LARGE: " << count << " times" << std::endl;
+                connection.closed = true;
+                break;
+            }
+            size_t size = sizeof(EphemerisRequest) + count * sizeof(float);
+            if (connection.in.size() - position < size)
+                break;
+
+            request.connection = index;
+            request.offset = 0;
+            if (request.request.body < BODY_COUNT)
+            {
+                std::vector<float>& times = bodyTimes[request.request.body];
+                request.offset = times.size();
+                times.resize(times.size() + count);
+                memcpy(&times[request.offset], &connection.in[position + sizeof(EphemerisRequest)], count * sizeof(float));
+            }
+            pending.push_back(request);
+            position += size;
+        }
+        connection.in.erase(connection.in.begin(), connection.in.begin() + position);
+    }
+
+    void evaluateBatch()
+    {
+        if (pending.empty())
+            return;
+        for (unsigned int b = 0; b < BODY_COUNT; b++)
+        {
+            unsigned int count = bodyTimes[b].size();
+            if (count == 0)
+                continue;
+            bodyX[b].resize(count);
+            bodyY[b].resize(count);
+            bodyZ[b].resize(count);
+            BODIES[b].positions(&bodyTimes[b][0], count, &bodyX[b][0], &bodyY[b][0], &bodyZ[b][0]);
+        }
+
+        for (unsigned int i = 0; i < pending.size(); i++)
+        {
+            const Pending& request = pending[i];
+            bool known = request.request.body < BODY_COUNT;
+            EphemerisResponse response;
+            response.id = request.request.id;
+            response.status = known ? EPHEMERIS_OK : EPHEMERIS_UNKNOWN_BODY;
+            response.count = known ? request.request.count : 0;
+
+            std::vector<char>& out = connections[request.connection].out;
+            size_t start = out.size();
+            out.resize(start + sizeof(EphemerisResponse) + response.count * 3 * sizeof(float));
+            memcpy(&out[start], &response, sizeof(EphemerisResponse));
+            float* xyz = (float*)&out[start + sizeof(EphemerisResponse)];
+            for (uint32_t t = 0; t < response.count; t++)
+            {
+                uint32_t source = request.offset + t;
+                xyz[t * 3 + 0] = bodyX[request.request.body][source];
+                xyz[t * 3 + 1] = bodyY[request.request.body][source];
+                xyz[t * 3 + 2] = bodyZ[request.request.body][source];
+            }
+            queries += response.count;
+        }
+
+        batches++;
+        pending.clear();
+        for (unsigned int b = 0; b < BODY_COUNT; b++)
+            bodyTimes[b].clear();
+    }
+
+    void send(Connection& connection)
+    {
+        while (connection.out.size() > connection.outStart)
+        {
+            // MSG_NOSIGNAL: a client that hung up must not kill the server with SIGPIPE
+            ssize_t n = ::send(connection.fd, &connection.out[connection.outStart], connection.out.size() - connection.outStart, MSG_NOSIGNAL);
+            if (n > 0)
+            {
+                connection.outStart += n;
+                continue;
+            }
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+            {
+                // peer is gone, throw away what we could not deliver
+                connection.closed = true;
+                connection.out.clear();
+                connection.outStart = 0;
+            }
+            return;
+        }
+        connection.out.clear();
+        connection.outStart = 0;
+    }
+};
+#endif
@@ -0,0 +1,138 @@
+#ifndef FRAME_ALLOCATOR_H
+#define FRAME_ALLOCATOR_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <iostream>
+
+#include "gpu_memory.h"
+
+// Per-frame dynamic data (uniform blocks, per-object data, streamed positions) without glBufferData.
+//
+// One buffer, created with glBufferStorage and kept persistently and coherently mapped, is split into
+// FRAMES regions. Each frame bump-allocates from its own region and writes straight into the mapping.
+// endFrame() fences the region, and beginFrame() only waits on that fence when the region comes round
+// again, i.e. when the CPU is FRAMES frames ahead of the GPU.
+class FrameAllocator
+{
+public:
+    static const unsigned int FRAMES = 3;
+
+    struct Allocation {
+        void* data;      // NULL if the frame's region is full
+        GLintptr offset; // offset in buffer()
+        GLsizeiptr size;
+    };
+
+    // statistics
+    unsigned long long stalls;    // beginFrame() calls that had to wait for the GPU
+    GLsizeiptr lastFrameBytes;    // bytes allocated in the previous frame
+    unsigned long long overflows; // allocations that did not fit
+
+    FrameAllocator(GLsizeiptr frameSize) : stalls(0), lastFrameBytes(0), overflows(0), frameSize(frameSize), frame(0), offset(0)
+    {
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &storageAlignment);
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &ID);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, frameSize * FRAMES, NULL, flags);
+        gpuMemory().allocate(GpuMemory::BUFFER, ID, GPU_MEMORY_STREAMING, "frame allocator", frameSize * FRAMES);
+        mapped = static_cast<char*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, frameSize * FRAMES, flags));
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        if (!mapped)
+            std::cout << "ERROR::FRAME_ALLOCATOR::MAP_FAILED" << std::endl;
+        for (unsigned int i = 0; i < FRAMES; i++)
+            fences[i] = 0;
+        end = frameSize;
+    }
+
+    ~FrameAllocator()
+    {
+        for (unsigned int i = 0; i < FRAMES; i++)
+            if (fences[i])
+                glDeleteSync(fences[i]);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, ID);
+        glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+        gpuMemory().release(GpuMemory::BUFFER, ID);
+        glDeleteBuffers(1, &ID);
+    }
+
+    // moves on to the next region, waiting for the GPU only if it still reads that region
+    void beginFrame()
+    {
+        lastFrameBytes = offset - (GLintptr)frame * frameSize;
+        frame = (frame + 1) % FRAMES;
+        if (fences[frame])
+        {
+            GLenum status = glClientWaitSync(fences[frame], 0, 0);
+            if (status == GL_TIMEOUT_EXPIRED)
+            {
+                stalls++;
+                do
+                    status = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+                while (status == GL_TIMEOUT_EXPIRED);
+            }
+            glDeleteSync(fences[frame]);
+            fences[frame] = 0;
+        }
+        offset = (GLintptr)frame * frameSize;
+        end = offset + frameSize;
+    }
+
+    // call after the last draw that reads this frame's allocations
+    void endFrame()
+    {
+        // everything written into the mapping this frame goes to the GPU
+        gpuMemory().uploaded(offset - (GLintptr)frame * frameSize);
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    Allocation allocate(GLsizeiptr size, GLint alignment = 4)
+    {
+        Allocation allocation;
+        GLintptr start = (offset + alignment - 1) / alignment * alignment;
+        if (!mapped || start + size > end)
+        {
+            if (overflows++ == 0)
+                std::cout << "ERROR::FRAME_ALLOCATOR::FRAME_FULL: " << size << " bytes requested, frame size is " << frameSize << std::endl;
+            allocation.data = NULL;
+            allocation.offset = 0;
+            allocation.size = 0;
+            return allocation;
+        }
+        allocation.data = mapped + start;
+        allocation.offset = start;
+        allocation.size = size;
+        offset = start + size;
+        return allocation;
+    }
+
+    // allocations that will be bound with glBindBufferRange
+    Allocation allocateUniform(GLsizeiptr size)
+    {
+        return allocate(size, uniformAlignment);
+    }
+
+    Allocation allocateStorage(GLsizeiptr size)
+    {
+        return allocate(size, storageAlignment);
+    }
+
+    unsigned int buffer() const
+    {
+        return ID;
+    }
+
+private:
+    unsigned int ID;
+    char* mapped;
+    GLsizeiptr frameSize;
+    unsigned int frame;
+    GLintptr offset, end;
+    GLsync fences[FRAMES];
+    GLint uniformAlignment, storageAlignment;
+};
+#endif
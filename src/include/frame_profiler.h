@@ -0,0 +1,285 @@
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Per-phase frame timing. Every phase of the render loop (input, simulation, each pass, present) is timed
+// on the CPU with a steady clock and on the GPU with a GL_TIME_ELAPSED query; per-frame counters (state
+// cache hits, queue size, ...) are recorded next to them.
+//
+// The GPU queries rotate through QUERY_SETS sets: the queries of frame N are polled at the start of frame
+// N + QUERY_SETS, when the GPU has normally finished them, instead of stalling frame N. A result that is
+// still not available then is dropped (counted in gpuSkips) rather than waited for; only finish() waits.
+// Phases must not nest, GL allows only one GL_TIME_ELAPSED query at a time, and each phase runs at most
+// once per frame.
+//
+// The last HISTORY frames are kept. report() prints p50/p95/p99/max of every phase, writeCsv() dumps one
+// row per frame. A frame whose CPU time is more than STUTTER_FACTOR times the recent average is a stutter.
+class FrameProfiler
+{
+public:
+    static const unsigned int HISTORY = 1 << 16;
+    static const unsigned int QUERY_SETS = 4;
+    static const unsigned int STUTTER_WARMUP = 60; // frames before stutters are counted, startup is noisy
+    static constexpr float STUTTER_FACTOR = 2.0f;
+
+    // statistics
+    unsigned long long frames;
+    unsigned long long stutters;
+    unsigned long long gpuSkips; // GPU times dropped because the query had no result yet
+
+    FrameProfiler(const std::vector<std::string>& phaseNames, const std::vector<std::string>& counterNames)
+        : frames(0), stutters(0), gpuSkips(0), phaseNames(phaseNames), counterNames(counterNames), averageFrameMs(0.0f)
+    {
+        stride = 2 + 2 * phaseNames.size() + counterNames.size();
+        rows.resize((size_t)HISTORY * stride);
+        queries.resize(QUERY_SETS * phaseNames.size());
+        issued.resize(QUERY_SETS * phaseNames.size(), false);
+        glGenQueries(queries.size(), &queries[0]);
+        for (unsigned int i = 0; i < QUERY_SETS; i++)
+            setFrame[i] = 0;
+        phaseStart.resize(phaseNames.size());
+    }
+
+    ~FrameProfiler()
+    {
+        glDeleteQueries(queries.size(), &queries[0]);
+    }
+
+    // call first thing in the frame: collects the GPU times of the frame that last used this query set
+    void beginFrame()
+    {
+        collect(frames % QUERY_SETS, false);
+        setFrame[frames % QUERY_SETS] = frames;
+        float* row = this->row(frames);
+        std::fill(row, row + stride, -1.0f);
+        row[COLUMN_STUTTER] = 0.0f;
+        frameStart = std::chrono::steady_clock::now();
+    }
+
+    void endFrame()
+    {
+        float* row = this->row(frames);
+        float frameMs = milliseconds(frameStart);
+        row[COLUMN_FRAME] = frameMs;
+        if (frames >= STUTTER_WARMUP && frameMs > STUTTER_FACTOR * averageFrameMs)
+        {
+            stutters++;
+            row[COLUMN_STUTTER] = 1.0f;
+        }
+        averageFrameMs = frames == 0 ? frameMs : 0.95f * averageFrameMs + 0.05f * frameMs;
+        frames++;
+    }
+
+    void beginPhase(unsigned int phase)
+    {
+        unsigned int query = (frames % QUERY_SETS) * phaseNames.size() + phase;
+        glBeginQuery(GL_TIME_ELAPSED, queries[query]);
+        issued[query] = true;
+        phaseStart[phase] = std::chrono::steady_clock::now();
+    }
+
+    void endPhase(unsigned int phase)
+    {
+        row(frames)[2 + phase] = milliseconds(phaseStart[phase]);
+        glEndQuery(GL_TIME_ELAPSED);
+    }
+
+    void setCounter(unsigned int counter, double value)
+    {
+        row(frames)[2 + 2 * phaseNames.size() + counter] = (float)value;
+    }
+
+    // reads the outstanding queries, call before report() or writeCsv()
+    void finish()
+    {
+        for (unsigned int i = 0; i < QUERY_SETS; i++)
+            collect(i, true);
+    }
+
+    void report() const
+    {
+        size_t count = retained();
+        std::printf("frame profile: %llu frames, %llu stutters (> %.1fx the running average), %llu gpu times not ready\n", frames, stutters,
+                    STUTTER_FACTOR, gpuSkips);
+        std::printf("%-14s %9s %9s %9s %9s | %9s %9s %9s %9s\n", "phase (ms)", "cpu p50", "p95", "p99", "max", "gpu p50", "p95", "p99", "max");
+        printPercentiles("frame", COLUMN_FRAME, (unsigned int)-1, count);
+        for (unsigned int i = 0; i < phaseNames.size(); i++)
+            printPercentiles(phaseNames[i].c_str(), 2 + i, 2 + phaseNames.size() + i, count);
+        for (unsigned int i = 0; i < counterNames.size(); i++)
+        {
+            std::vector<float> values = column(2 + 2 * phaseNames.size() + i, count);
+            double sum = 0.0, max = 0.0;
+            for (size_t j = 0; j < values.size(); j++)
+            {
+                sum += values[j];
+                max = std::max(max, (double)values[j]);
+            }
+            std::printf("%-24s mean %12.1f  max %12.1f  total %14.0f\n", counterNames[i].c_str(),
+                        values.empty() ? 0.0 : sum / values.size(), max, sum);
+        }
+    }
+
+    // one row per retained frame; phases that did not run in a frame are left empty
+    bool writeCsv(const std::string& path) const
+    {
+        std::ofstream file(path.c_str(), std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "ERROR::PROFILER::FILE_NOT_SUCCESFULLY_WRITTEN: " << path << std::endl;
+            return false;
+        }
+        file << "frame,frame_ms,stutter";
+        for (unsigned int i = 0; i < phaseNames.size(); i++)
+            file << ",cpu_" << phaseNames[i] << "_ms";
+        for (unsigned int i = 0; i < phaseNames.size(); i++)
+            file << ",gpu_" << phaseNames[i] << "_ms";
+        for (unsigned int i = 0; i < counterNames.size(); i++)
+            file << "," << counterNames[i];
+        file << "\n";
+        size_t count = retained();
+        for (unsigned long long frame = frames - count; frame < frames; frame++)
+        {
+            const float* row = this->row(frame);
+            file << frame << "," << row[COLUMN_FRAME] << "," << (int)row[COLUMN_STUTTER];
+            for (unsigned int i = 2; i < stride; i++)
+            {
+                file << ",";
+                if (row[i] >= 0.0f)
+                    file << row[i];
+            }
+            file << "\n";
+        }
+        return true;
+    }
+
+private:
+    static const unsigned int COLUMN_FRAME = 0;
+    static const unsigned int COLUMN_STUTTER = 1;
+
+    // row layout: frame ms, stutter, cpu ms per phase, gpu ms per phase, counters; -1 if not recorded
+    std::vector<std::string> phaseNames, counterNames;
+    unsigned int stride;
+    std::vector<float> rows;
+    std::vector<unsigned int> queries; // QUERY_SETS sets of one query per phase
+    std::vector<bool> issued;
+    unsigned long long setFrame[QUERY_SETS];
+    float averageFrameMs;
+    std::chrono::steady_clock::time_point frameStart;
+    std::vector<std::chrono::steady_clock::time_point> phaseStart;
+
+    float* row(unsigned long long frame)
+    {
+        return &rows[(size_t)(frame % HISTORY) * stride];
+    }
+
+    const float* row(unsigned long long frame) const
+    {
+        return &rows[(size_t)(frame % HISTORY) * stride];
+    }
+
+    size_t retained() const
+    {
+        return (size_t)std::min(frames, (unsigned long long)HISTORY);
+    }
+
+    static float milliseconds(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    // stores the results of a query set into the row of the frame that issued it; without wait, results
+    // the GPU has not produced yet are dropped
+    void collect(unsigned int set, bool wait)
+    {
+        float* row = this->row(setFrame[set]);
+        for (unsigned int phase = 0; phase < phaseNames.size(); phase++)
+        {
+            unsigned int query = set * phaseNames.size() + phase;
+            if (!issued[query])
+                continue;
+            issued[query] = false;
+            if (!wait)
+            {
+                GLuint available = GL_FALSE;
+                glGetQueryObjectuiv(queries[query], GL_QUERY_RESULT_AVAILABLE, &available);
+                if (!available)
+                {
+                    gpuSkips++;
+                    continue;
+                }
+            }
+            GLuint64 nanoseconds = 0;
+            glGetQueryObjectui64v(queries[query], GL_QUERY_RESULT, &nanoseconds);
+            // the first frame pays for lazy driver setup, and llvmpipe even reports its first timed draw
+            // relative to the epoch, so its GPU times are not recorded
+            if (setFrame[set] > 0)
+                row[2 + phaseNames.size() + phase] = nanoseconds * 1.0e-6f;
+        }
+    }
+
+    std::vector<float> column(unsigned int index, size_t count) const
+    {
+        std::vector<float> values;
+        values.reserve(count);
+        for (unsigned long long frame = frames - count; frame < frames; frame++)
+            if (row(frame)[index] >= 0.0f)
+                values.push_back(row(frame)[index]);
+        return values;
+    }
+
+    void printPercentiles(const char* name, unsigned int cpuColumn, unsigned int gpuColumn, size_t count) const
+    {
+        std::printf("%-14s", name);
+        for (unsigned int pass = 0; pass < 2; pass++)
+        {
+            unsigned int index = pass == 0 ? cpuColumn : gpuColumn;
+            std::vector<float> values;
+            if (index != (unsigned int)-1)
+                values = column(index, count);
+            if (pass == 1)
+                std::printf(" |");
+            if (values.empty())
+            {
+                std::printf(" %9s %9s %9s %9s", "-", "-", "-", "-");
+                continue;
+            }
+            std::sort(values.begin(), values.end());
+            const double quantiles[3] = { 0.50, 0.95, 0.99 };
+            for (unsigned int q = 0; q < 3; q++)
+                std::printf(" %9.3f", values[(size_t)(quantiles[q] * (values.size() - 1) + 0.5)]);
+            std::printf(" %9.3f", values.back());
+        }
+        std::printf("\n");
+    }
+};
+
+// CPU and GPU time of the enclosing block; does nothing without a profiler
+class ProfileScope
+{
+public:
+    ProfileScope(FrameProfiler* profiler, unsigned int phase) : profiler(profiler), phase(phase)
+    {
+        if (profiler)
+            profiler->beginPhase(phase);
+    }
+
+    ~ProfileScope()
+    {
+        if (profiler)
+            profiler->endPhase(phase);
+    }
+
+private:
+    FrameProfiler* profiler;
+    unsigned int phase;
+};
+#endif
@@ -0,0 +1,61 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "frame_allocator.h"
+
+// uniform buffer binding point of the Frame block, the same in every program
+const unsigned int FRAME_UNIFORM_BINDING = 0;
+
+// std140 layout of the Frame uniform block. Every shader that needs the camera declares
+//
+//     layout (std140, binding = 0) uniform Frame {
+//         mat4 view; mat4 projection; mat4 viewProj; vec4 cameraPos; float time; float simulationTime;
+//     };
+//
+// cameraPos is a vec4 (w unused) so that the C++ struct needs no std140 padding rules for vec3.
+struct FrameUniforms {
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProj;
+    glm::vec4 cameraPos;
+    float time;           // seconds since start
+    float simulationTime; // simulation days
+    float padding[2];
+};
+
+// Camera and time constants shared by all programs. update() writes them once per frame into the frame
+// allocator and binds that range to the Frame block's binding point, so no program needs its own
+// view/projection/cameraPos uniforms.
+class FrameUniformBuffer
+{
+public:
+    FrameUniformBuffer(FrameAllocator& allocator) : allocator(allocator) {}
+
+    void update(const glm::mat4& view, const glm::mat4& projection, const glm::vec3& cameraPos, float time, float simulationTime)
+    {
+        FrameAllocator::Allocation allocation = allocator.allocateUniform(sizeof(FrameUniforms));
+        if (!allocation.data)
+            return;
+        FrameUniforms* frame = static_cast<FrameUniforms*>(allocation.data);
+        frame->view = view;
+        frame->projection = projection;
+        frame->viewProj = projection * view;
+        frame->cameraPos = glm::vec4(cameraPos, 1.0f);
+        frame->time = time;
+        frame->simulationTime = simulationTime;
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, allocator.buffer(), allocation.offset, allocation.size);
+    }
+
+private:
+    FrameAllocator& allocator;
+};
+
+// normal matrix of a model matrix, computed once per object instead of once per vertex
+inline glm::mat3 normalMatrix(const glm::mat4& model)
+{
+    return glm::transpose(glm::inverse(glm::mat3(model)));
+}
+#endif
@@ -0,0 +1,139 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include <glad/glad.h>
+
+// Thin cache in front of the binds the render loop issues every frame: program, vertex array, active
+// texture unit and the textures bound to each unit. A call that would not change the bound object is
+// skipped and counted as a hit, everything else goes to GL and counts as a miss.
+//
+// The cache only knows about binds made through it. Code that binds with raw GL calls (the loaders
+// and buffer setup at startup) must be followed by invalidate() before the cache is relied on again.
+class GLStateCache
+{
+public:
+    struct Counters {
+        unsigned long long hits;
+        unsigned long long misses;
+    };
+
+    // texture units and targets tracked; binds outside them always go through to GL
+    static const unsigned int MAX_UNITS = 16;
+    static const unsigned int TARGET_COUNT = 4;
+
+    GLStateCache()
+    {
+        invalidate();
+        frame.hits = frame.misses = 0;
+        lastFrame = frame;
+    }
+
+    void useProgram(GLuint program)
+    {
+        if (check(program == currentProgram))
+            return;
+        glUseProgram(program);
+        currentProgram = program;
+    }
+
+    void bindVertexArray(GLuint vertexArray)
+    {
+        if (check(vertexArray == currentVertexArray))
+            return;
+        glBindVertexArray(vertexArray);
+        currentVertexArray = vertexArray;
+    }
+
+    // unit is GL_TEXTURE0 + n, as for glActiveTexture
+    void activeTexture(GLenum unit)
+    {
+        if (check(unit == currentUnit))
+            return;
+        glActiveTexture(unit);
+        currentUnit = unit;
+    }
+
+    // binds to the active texture unit
+    void bindTexture(GLenum target, GLuint texture)
+    {
+        unsigned int unit = currentUnit - GL_TEXTURE0;
+        int slot = targetSlot(target);
+        if (currentUnit == UNKNOWN || unit >= MAX_UNITS || slot < 0)
+        {
+            frame.misses++;
+            glBindTexture(target, texture);
+            return;
+        }
+        if (check(textures[unit][slot] == texture))
+            return;
+        glBindTexture(target, texture);
+        textures[unit][slot] = texture;
+    }
+
+    // forget everything, the next bind of each kind goes to GL
+    void invalidate()
+    {
+        currentProgram = UNKNOWN;
+        currentVertexArray = UNKNOWN;
+        currentUnit = UNKNOWN;
+        for (unsigned int unit = 0; unit < MAX_UNITS; unit++)
+            for (unsigned int slot = 0; slot < TARGET_COUNT; slot++)
+                textures[unit][slot] = UNKNOWN;
+    }
+
+    // starts counting a new frame, the finished frame's counters stay available in lastFrame
+    void beginFrame()
+    {
+        lastFrame = frame;
+        frame.hits = frame.misses = 0;
+    }
+
+    const Counters& currentFrameCounters() const
+    {
+        return frame;
+    }
+
+    const Counters& lastFrameCounters() const
+    {
+        return lastFrame;
+    }
+
+private:
+    static const GLuint UNKNOWN = 0xffffffffu;
+
+    GLuint currentProgram;
+    GLuint currentVertexArray;
+    GLenum currentUnit;
+    GLuint textures[MAX_UNITS][TARGET_COUNT];
+    Counters frame;
+    Counters lastFrame;
+
+    bool check(bool hit)
+    {
+        if (hit)
+            frame.hits++;
+        else
+            frame.misses++;
+        return hit;
+    }
+
+    static int targetSlot(GLenum target)
+    {
+        switch (target)
+        {
+        case GL_TEXTURE_2D: return 0;
+        case GL_TEXTURE_2D_ARRAY: return 1;
+        case GL_TEXTURE_CUBE_MAP: return 2;
+        case GL_TEXTURE_3D: return 3;
+        default: return -1;
+        }
+    }
+};
+
+// the cache of the one GL context the application uses
+inline GLStateCache& glState()
+{
+    static GLStateCache state;
+    return state;
+}
+#endif
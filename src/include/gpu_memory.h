@@ -0,0 +1,266 @@
+#ifndef GPU_MEMORY_H
+#define GPU_MEMORY_H
+
+#include <glad/glad.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "texture_formats.h"
+
+// what an allocation is for, the rows of GpuMemory::report()
+enum GpuMemoryCategory {
+    GPU_MEMORY_MESHES,     // vertex, index, material and draw buffers
+    GPU_MEMORY_TEXTURES,
+    GPU_MEMORY_STREAMING,  // persistently mapped per-frame data, upload staging and readback buffers
+    GPU_MEMORY_SIMULATION, // N-body storage buffers
+    GPU_MEMORY_TARGETS,    // offscreen render targets
+    GPU_MEMORY_CATEGORY_COUNT
+};
+
+// Accounting of the video memory the application allocates and of the bytes it uploads each frame.
+//
+// Every site that creates a buffer, texture or renderbuffer reports it with allocate() right after the
+// storage call, under a category and the asset it belongs to (a file path, "sphere mesh", ...), and with
+// release() before deleting it. Textures are counted with their whole mip chain, estimated from the
+// internal format by textureBytes() as drivers do not report what they actually reserve; unsized RGB is
+// counted at 4 bytes per texel, as drivers store it. Allocations made without an asset name take the one
+// of the innermost GpuAssetScope, so Mesh::setupMesh calls made while a model loads count to the model.
+//
+// uploaded() adds to the bytes sent to the GPU this frame, beginFrame() closes the frame. report() prints
+// the totals per category, the largest assets and the upload bandwidth; all calls come from the GL thread.
+class GpuMemory
+{
+public:
+    enum ObjectKind { BUFFER, TEXTURE, RENDERBUFFER };
+
+    static const unsigned int REPORT_ASSETS = 16; // largest assets listed by report()
+
+    // statistics
+    unsigned long long frames;
+    size_t lastFrameUploadBytes;
+    size_t peakFrameUploadBytes;
+    unsigned long long totalUploadBytes;
+
+    GpuMemory()
+        : frames(0), lastFrameUploadBytes(0), peakFrameUploadBytes(0), totalUploadBytes(0), frameUploadBytes(0), startupUploadBytes(0), total(0),
+          peak(0)
+    {
+        std::fill(categoryTotals, categoryTotals + GPU_MEMORY_CATEGORY_COUNT, 0);
+    }
+
+    // object now holds bytes of video memory; an object reported again, as when it is respecified, is
+    // counted once with its latest size
+    void allocate(ObjectKind kind, unsigned int object, GpuMemoryCategory category, const std::string& asset, size_t bytes)
+    {
+        release(kind, object);
+        Allocation& allocation = allocations[Key(kind, object)];
+        allocation.category = category;
+        allocation.asset = !asset.empty() ? asset : !assetScopes.empty() ? assetScopes.back() : "unnamed";
+        allocation.bytes = bytes;
+        categoryTotals[category] += bytes;
+        total += bytes;
+        peak = std::max(peak, total);
+    }
+
+    // new size of an object already reported, keeping its category and asset
+    void resize(ObjectKind kind, unsigned int object, size_t bytes)
+    {
+        std::map<Key, Allocation>::iterator found = allocations.find(Key(kind, object));
+        if (found == allocations.end())
+            return;
+        categoryTotals[found->second.category] += bytes - found->second.bytes;
+        total += bytes - found->second.bytes;
+        found->second.bytes = bytes;
+        peak = std::max(peak, total);
+    }
+
+    void release(ObjectKind kind, unsigned int object)
+    {
+        std::map<Key, Allocation>::iterator found = allocations.find(Key(kind, object));
+        if (found == allocations.end())
+            return;
+        categoryTotals[found->second.category] -= found->second.bytes;
+        total -= found->second.bytes;
+        allocations.erase(found);
+    }
+
+    // bytes written to the GPU: buffer and texture uploads, writes into persistently mapped memory
+    void uploaded(size_t bytes)
+    {
+        frameUploadBytes += bytes;
+        totalUploadBytes += bytes;
+    }
+
+    // call once per frame, before its uploads
+    void beginFrame()
+    {
+        if (frames == 0)
+        {
+            // what was uploaded before the first frame is startup, not per-frame bandwidth
+            start = std::chrono::steady_clock::now();
+            startupUploadBytes = totalUploadBytes;
+        }
+        else
+        {
+            lastFrameUploadBytes = frameUploadBytes;
+            peakFrameUploadBytes = std::max(peakFrameUploadBytes, frameUploadBytes);
+        }
+        frameUploadBytes = 0;
+        frames++;
+    }
+
+    // bytes uploaded since beginFrame()
+    size_t currentFrameUploadBytes() const
+    {
+        return frameUploadBytes;
+    }
+
+    size_t bytes(GpuMemoryCategory category) const
+    {
+        return categoryTotals[category];
+    }
+
+    size_t totalBytes() const
+    {
+        return total;
+    }
+
+    size_t peakBytes() const
+    {
+        return peak;
+    }
+
+    // bytes per asset, largest first
+    std::vector<std::pair<std::string, size_t> > assets() const
+    {
+        std::map<std::string, size_t> sums;
+        for (std::map<Key, Allocation>::const_iterator i = allocations.begin(); i != allocations.end(); ++i)
+            sums[i->second.asset] += i->second.bytes;
+        std::vector<std::pair<std::string, size_t> > sorted(sums.begin(), sums.end());
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [](const std::pair<std::string, size_t>& a, const std::pair<std::string, size_t>& b) { return a.second > b.second; });
+        return sorted;
+    }
+
+    void report() const
+    {
+        static const char* const names[GPU_MEMORY_CATEGORY_COUNT] = { "meshes", "textures", "streaming", "simulation", "targets" };
+        printf("gpu memory: %.1f MB in %u objects, peak %.1f MB\n", megabytes(total), (unsigned int)allocations.size(), megabytes(peak));
+        for (unsigned int i = 0; i < GPU_MEMORY_CATEGORY_COUNT; i++)
+            printf("  %-12s %10.1f MB\n", names[i], megabytes(categoryTotals[i]));
+        std::vector<std::pair<std::string, size_t> > sorted = assets();
+        printf("largest assets:\n");
+        for (unsigned int i = 0; i < sorted.size() && i < REPORT_ASSETS; i++)
+            printf("  %10.1f MB  %s\n", megabytes(sorted[i].second), sorted[i].first.c_str());
+        if (sorted.size() > REPORT_ASSETS)
+            printf("  ... %u more\n", (unsigned int)(sorted.size() - REPORT_ASSETS));
+        double seconds = frames > 1 ? std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() : 0.0;
+        printf("uploads: %.1f MB before the first frame, %.1f KB last frame, %.1f KB peak frame", megabytes(frames ? startupUploadBytes : totalUploadBytes),
+               lastFrameUploadBytes / 1024.0, peakFrameUploadBytes / 1024.0);
+        if (seconds > 0.0)
+            printf(", %.1f MB/s over %llu frames", megabytes(totalUploadBytes - startupUploadBytes) / seconds, frames);
+        printf("\n");
+    }
+
+    // levels of a full mip chain
+    static int mipLevels(int width, int height)
+    {
+        int levels = 1;
+        while ((std::max(width, height) >> levels) > 0)
+            levels++;
+        return levels;
+    }
+
+    // estimated video memory of levels mip levels of a texture, layers are array layers or cube faces
+    static size_t textureBytes(GLenum internalFormat, int width, int height, int layers, int levels)
+    {
+        bool blocks = isCompressed(internalFormat);
+        size_t bits = texelBits(internalFormat), total = 0;
+        for (int l = 0; l < levels; l++)
+        {
+            size_t w = std::max(width >> l, 1), h = std::max(height >> l, 1);
+            if (blocks)
+            {
+                w = (w + 3) / 4 * 4;
+                h = (h + 3) / 4 * 4;
+            }
+            total += w * h * bits / 8;
+        }
+        return total * layers;
+    }
+
+private:
+    typedef std::pair<int, unsigned int> Key;
+
+    struct Allocation {
+        GpuMemoryCategory category;
+        std::string asset;
+        size_t bytes;
+    };
+
+    std::map<Key, Allocation> allocations;
+    size_t categoryTotals[GPU_MEMORY_CATEGORY_COUNT];
+    size_t frameUploadBytes;
+    unsigned long long startupUploadBytes;
+    size_t total;
+    size_t peak;
+    std::chrono::steady_clock::time_point start;
+    std::vector<std::string> assetScopes;
+
+    friend class GpuAssetScope;
+
+    static bool isCompressed(GLenum internalFormat)
+    {
+        return internalFormat == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || internalFormat == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ||
+               internalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+
+    static size_t texelBits(GLenum internalFormat)
+    {
+        switch (internalFormat)
+        {
+        case GL_COMPRESSED_RGB_S3TC_DXT1_EXT: return 4;
+        case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        case GL_COMPRESSED_RGBA_BPTC_UNORM: return 8;
+        case GL_RED:
+        case GL_R8: return 8;
+        case GL_RG:
+        case GL_RG8: return 16;
+        default: return 32; // RGB, RGB8, RGBA, RGBA8, DEPTH_COMPONENT24
+        }
+    }
+
+    static double megabytes(double bytes)
+    {
+        return bytes / (1024.0 * 1024.0);
+    }
+};
+
+// the accounting of the one GL context the application uses
+inline GpuMemory& gpuMemory()
+{
+    static GpuMemory memory;
+    return memory;
+}
+
+// allocations without an asset name made during the scope count to this asset
+class GpuAssetScope
+{
+public:
+    GpuAssetScope(const std::string& asset)
+    {
+        gpuMemory().assetScopes.push_back(asset);
+    }
+
+    ~GpuAssetScope()
+    {
+        gpuMemory().assetScopes.pop_back();
+    }
+};
+#endif
@@ -0,0 +1,87 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <glad/glad.h>
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstring>
+#include <iostream>
+
+// OpenGL core context without a window or a display server, for rendering on machines without a GPU
+// (Mesa llvmpipe) or without X11/Wayland. Uses Mesa's surfaceless EGL platform when it is available and
+// the default display otherwise; the context is made current without a surface, so everything has to be
+// drawn into a framebuffer object (see offscreen_target.h).
+class HeadlessContext
+{
+public:
+    HeadlessContext(int major, int minor) : display(EGL_NO_DISPLAY), context(EGL_NO_CONTEXT)
+    {
+        const char* clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+        PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay && clientExtensions && std::strstr(clientExtensions, "EGL_MESA_platform_surfaceless"))
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+        if (display == EGL_NO_DISPLAY)
+            display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+        EGLint versionMajor, versionMinor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &versionMajor, &versionMinor))
+        {
+            std::cout << "ERROR::HEADLESS::NO_EGL_DISPLAY" << std::endl;
+            display = EGL_NO_DISPLAY;
+            return;
+        }
+        eglBindAPI(EGL_OPENGL_API);
+
+        // any config will do, nothing is ever drawn to an EGL surface
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config = EGL_NO_CONFIG_KHR;
+        EGLint configCount = 0;
+        eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+        if (configCount == 0)
+            config = EGL_NO_CONFIG_KHR;
+
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, major,
+            EGL_CONTEXT_MINOR_VERSION, minor,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            std::cout << "ERROR::HEADLESS::CONTEXT_CREATION_FAILED: OpenGL " << major << "." << minor
+                      << " core, EGL error 0x" << std::hex << eglGetError() << std::dec << std::endl;
+            if (context != EGL_NO_CONTEXT)
+                eglDestroyContext(display, context);
+            context = EGL_NO_CONTEXT;
+        }
+    }
+
+    ~HeadlessContext()
+    {
+        if (display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+    }
+
+    bool isValid() const
+    {
+        return context != EGL_NO_CONTEXT;
+    }
+
+    // loader for glad
+    static void* getProcAddress(const char* name)
+    {
+        return (void*)eglGetProcAddress(name);
+    }
+
+private:
+    EGLDisplay display;
+    EGLContext context;
+};
+#endif
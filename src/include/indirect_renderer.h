@@ -0,0 +1,332 @@
+#ifndef INDIRECT_RENDERER_H
+#define INDIRECT_RENDERER_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <vector>
+
+#include "mesh.h"
+#include "model.h"
+#include "gl_state.h"
+#include "gpu_memory.h"
+#include "frame_allocator.h"
+
+// per-object data in the object storage buffer (binding 1), must match ObjectData in sphereVert.vert
+struct ObjectData {
+    glm::mat4 model;
+    unsigned int material;
+    unsigned int padding[3];
+};
+
+// entry of the material storage buffer (binding 2): layer of the bound texture array, or -1 for an
+// untextured surface, and a tint color
+struct MaterialData {
+    glm::vec4 color;
+    int layer;
+    int padding[3];
+};
+
+// layout of one glMultiDrawElementsIndirect command
+struct DrawElementsIndirectCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+// Draws any number of objects with one glMultiDrawElementsIndirect per flush.
+//
+// Every mesh (spheres, meshes of a Model) is appended to one shared vertex and index buffer. During a
+// frame draw() only records the object's transform and material, after testing the mesh's bounding sphere
+// against the frustum given to setFrustum(); objects outside it are dropped, so the commands built from
+// the recorded objects only cover the visible ones. flush() groups the objects by mesh,
+// uploads them to the object storage buffer and emits one indirect command per mesh that is in use, with
+// instanceCount objects starting at baseInstance. A per-instance vertex attribute holding 0, 1, 2, ...
+// (location 5) turns baseInstance + gl_InstanceID into the object's index, so the vertex shader can
+// fetch its transform without GL 4.6 draw parameters. The per-frame objects and commands are written
+// straight into the frame allocator's mapped buffer.
+class IndirectRenderer
+{
+public:
+    // statistics of the last flush
+    unsigned int lastObjectCount;
+    unsigned int lastCommandCount;
+    unsigned int lastCulledCount; // objects drawn outside the frustum since the flush before
+
+    IndirectRenderer(FrameAllocator& allocator)
+        : lastObjectCount(0), lastCommandCount(0), lastCulledCount(0), allocator(allocator), geometryDirty(false), materialsDirty(false),
+          objectIndexCapacity(0), culling(false), culledCount(0)
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &objectIndexBuffer);
+        glGenBuffers(1, &materialBuffer);
+
+        glState().bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        // same vertex layout as Mesh::setupMesh
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, TexCoords));
+        // object index, advanced once per instance
+        glBindBuffer(GL_ARRAY_BUFFER, objectIndexBuffer);
+        glEnableVertexAttribArray(5);
+        glVertexAttribIPointer(5, 1, GL_UNSIGNED_INT, sizeof(unsigned int), (void*)0);
+        glVertexAttribDivisor(5, 1);
+        glState().bindVertexArray(0);
+    }
+
+    ~IndirectRenderer()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        unsigned int buffers[] = { VBO, EBO, objectIndexBuffer, materialBuffer };
+        for (unsigned int i = 0; i < 4; i++)
+            gpuMemory().release(GpuMemory::BUFFER, buffers[i]);
+        glDeleteBuffers(4, buffers);
+    }
+
+    // adds a mesh to the shared buffers and returns its handle. Triangle strips are converted to lists
+    // so that every mesh can be drawn by the same GL_TRIANGLES command stream.
+    unsigned int addMesh(const vector<Vertex>& meshVertices, const vector<unsigned int>& meshIndices, GLenum mode = GL_TRIANGLES)
+    {
+        MeshRange range;
+        range.firstIndex = indices.size();
+        range.baseVertex = vertices.size();
+        vertices.insert(vertices.end(), meshVertices.begin(), meshVertices.end());
+        if (mode == GL_TRIANGLE_STRIP)
+        {
+            for (unsigned int i = 2; i < meshIndices.size(); i++)
+            {
+                // every other triangle of a strip has reversed winding
+                bool odd = (i & 1) != 0;
+                indices.push_back(meshIndices[i - 2]);
+                indices.push_back(meshIndices[odd ? i : i - 1]);
+                indices.push_back(meshIndices[odd ? i - 1 : i]);
+            }
+        }
+        else
+            indices.insert(indices.end(), meshIndices.begin(), meshIndices.end());
+        range.indexCount = indices.size() - range.firstIndex;
+        // bounding sphere around the center of the bounding box
+        glm::vec3 low(0.0f), high(0.0f);
+        for (unsigned int i = 0; i < meshVertices.size(); i++)
+        {
+            low = i == 0 ? meshVertices[i].Position : glm::min(low, meshVertices[i].Position);
+            high = i == 0 ? meshVertices[i].Position : glm::max(high, meshVertices[i].Position);
+        }
+        range.center = (low + high) * 0.5f;
+        range.radius = 0.0f;
+        for (unsigned int i = 0; i < meshVertices.size(); i++)
+            range.radius = std::max(range.radius, glm::length(meshVertices[i].Position - range.center));
+        meshes.push_back(range);
+        geometryDirty = true;
+        return meshes.size() - 1;
+    }
+
+    // adds every mesh of a model, returns their handles in Model::meshes order
+    vector<unsigned int> addModel(const Model& model)
+    {
+        vector<unsigned int> handles;
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+            handles.push_back(addMesh(model.meshes[i].vertices, model.meshes[i].indices));
+        return handles;
+    }
+
+    unsigned int addMaterial(int layer, const glm::vec4& color = glm::vec4(1.0f))
+    {
+        MaterialData material;
+        material.color = color;
+        material.layer = layer;
+        materials.push_back(material);
+        materialsDirty = true;
+        return materials.size() - 1;
+    }
+
+    // planes of the view frustum that draw() culls against from now on
+    void setFrustum(const glm::mat4& viewProjection)
+    {
+        // Gribb-Hartmann: each plane is the last row of the matrix plus or minus one of the others
+        for (unsigned int i = 0; i < 6; i++)
+        {
+            unsigned int row = i / 2;
+            float sign = i % 2 == 0 ? 1.0f : -1.0f;
+            glm::vec4 plane;
+            for (unsigned int column = 0; column < 4; column++)
+                plane[column] = viewProjection[column][3] + sign * viewProjection[column][row];
+            frustum[i] = plane / glm::length(glm::vec3(plane));
+        }
+        culling = true;
+    }
+
+    // records one object for the next flush, unless it is outside the frustum
+    void draw(unsigned int mesh, const glm::mat4& model, unsigned int material)
+    {
+        if (culling && !visible(meshes[mesh], model))
+        {
+            culledCount++;
+            return;
+        }
+        PendingObject object;
+        object.mesh = mesh;
+        object.data.model = model;
+        object.data.material = material;
+        pending.push_back(object);
+    }
+
+    void drawModel(const vector<unsigned int>& modelMeshes, const glm::mat4& model, unsigned int material)
+    {
+        for (unsigned int i = 0; i < modelMeshes.size(); i++)
+            draw(modelMeshes[i], model, material);
+    }
+
+    // draws everything recorded since the last flush with the currently bound program
+    void flush()
+    {
+        lastObjectCount = pending.size();
+        lastCommandCount = 0;
+        lastCulledCount = culledCount;
+        culledCount = 0;
+        if (pending.empty())
+            return;
+        uploadStaticData();
+
+        // group objects by mesh (counting sort), one command per mesh in use
+        meshCounts.assign(meshes.size() + 1, 0);
+        unsigned int commandCount = 0;
+        for (unsigned int i = 0; i < pending.size(); i++)
+            meshCounts[pending[i].mesh + 1]++;
+        for (unsigned int m = 0; m < meshes.size(); m++)
+            if (meshCounts[m + 1] > 0)
+                commandCount++;
+
+        FrameAllocator::Allocation objectAllocation = allocator.allocateStorage(pending.size() * sizeof(ObjectData));
+        FrameAllocator::Allocation commandAllocation = allocator.allocate(commandCount * sizeof(DrawElementsIndirectCommand));
+        if (!objectAllocation.data || !commandAllocation.data)
+        {
+            pending.clear();
+            return;
+        }
+        DrawElementsIndirectCommand* commands = static_cast<DrawElementsIndirectCommand*>(commandAllocation.data);
+        ObjectData* objects = static_cast<ObjectData*>(objectAllocation.data);
+        for (unsigned int m = 0, c = 0; m < meshes.size(); m++)
+        {
+            if (meshCounts[m + 1] > 0)
+            {
+                DrawElementsIndirectCommand command;
+                command.count = meshes[m].indexCount;
+                command.instanceCount = meshCounts[m + 1];
+                command.firstIndex = meshes[m].firstIndex;
+                command.baseVertex = meshes[m].baseVertex;
+                command.baseInstance = meshCounts[m];
+                commands[c++] = command;
+            }
+            meshCounts[m + 1] += meshCounts[m];
+        }
+        for (unsigned int i = 0; i < pending.size(); i++)
+            objects[meshCounts[pending[i].mesh]++] = pending[i].data;
+
+        ensureObjectIndices(pending.size());
+        pending.clear();
+
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 1, allocator.buffer(), objectAllocation.offset, objectAllocation.size);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, materialBuffer);
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, allocator.buffer());
+        glState().bindVertexArray(VAO);
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, (void*)commandAllocation.offset, commandCount, 0);
+        lastCommandCount = commandCount;
+    }
+
+private:
+    struct MeshRange {
+        unsigned int firstIndex;
+        unsigned int indexCount;
+        int baseVertex;
+        glm::vec3 center; // bounding sphere in object space
+        float radius;
+    };
+
+    struct PendingObject {
+        unsigned int mesh;
+        ObjectData data;
+    };
+
+    FrameAllocator& allocator;
+    unsigned int VAO, VBO, EBO;
+    unsigned int objectIndexBuffer, materialBuffer;
+    bool geometryDirty;
+    bool materialsDirty;
+    unsigned int objectIndexCapacity;
+
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<MeshRange> meshes;
+    vector<MaterialData> materials;
+    vector<PendingObject> pending;
+    vector<unsigned int> meshCounts;
+    bool culling;
+    glm::vec4 frustum[6]; // planes with inward unit normals
+    unsigned int culledCount;
+
+    bool visible(const MeshRange& mesh, const glm::mat4& model) const
+    {
+        glm::vec3 center = glm::vec3(model * glm::vec4(mesh.center, 1.0f));
+        float scale = std::max(glm::length(glm::vec3(model[0])), std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        float radius = mesh.radius * scale;
+        for (unsigned int i = 0; i < 6; i++)
+            if (glm::dot(glm::vec3(frustum[i]), center) + frustum[i].w < -radius)
+                return false;
+        return true;
+    }
+
+    // geometry and materials only change when meshes or materials are added
+    void uploadStaticData()
+    {
+        if (geometryDirty)
+        {
+            // the element buffer binding is vertex array state, keep it out of whichever VAO is bound
+            glState().bindVertexArray(VAO);
+            glBindBuffer(GL_ARRAY_BUFFER, VBO);
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+            gpuMemory().allocate(GpuMemory::BUFFER, VBO, GPU_MEMORY_MESHES, "indirect renderer geometry", vertices.size() * sizeof(Vertex));
+            gpuMemory().allocate(GpuMemory::BUFFER, EBO, GPU_MEMORY_MESHES, "indirect renderer geometry", indices.size() * sizeof(unsigned int));
+            gpuMemory().uploaded(vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int));
+            geometryDirty = false;
+        }
+        if (materialsDirty && !materials.empty())
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, materialBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, materials.size() * sizeof(MaterialData), &materials[0], GL_STATIC_DRAW);
+            gpuMemory().allocate(GpuMemory::BUFFER, materialBuffer, GPU_MEMORY_MESHES, "indirect renderer materials", materials.size() * sizeof(MaterialData));
+            gpuMemory().uploaded(materials.size() * sizeof(MaterialData));
+            materialsDirty = false;
+        }
+    }
+
+    // the object index attribute must cover every object of a flush
+    void ensureObjectIndices(unsigned int count)
+    {
+        if (count <= objectIndexCapacity)
+            return;
+        objectIndexCapacity = 64;
+        while (objectIndexCapacity < count)
+            objectIndexCapacity *= 2;
+        vector<unsigned int> sequence(objectIndexCapacity);
+        for (unsigned int i = 0; i < objectIndexCapacity; i++)
+            sequence[i] = i;
+        glBindBuffer(GL_ARRAY_BUFFER, objectIndexBuffer);
+        glBufferData(GL_ARRAY_BUFFER, sequence.size() * sizeof(unsigned int), &sequence[0], GL_STATIC_DRAW);
+        gpuMemory().allocate(GpuMemory::BUFFER, objectIndexBuffer, GPU_MEMORY_MESHES, "indirect renderer object indices", sequence.size() * sizeof(unsigned int));
+        gpuMemory().uploaded(sequence.size() * sizeof(unsigned int));
+    }
+};
+#endif
@@ -0,0 +1,315 @@
+#ifndef KTX2_H
+#define KTX2_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Reads and writes the subset of KTX 2.0 (https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html) that
+// the texture baker produces: one 2D image, no array layers or faces, no supercompression, a block-compressed
+// format and its mip chain. Other KTX2 files are rejected with an error.
+//
+// Baked textures live next to their source image with the extension replaced by .ktx2 (see ktx2Path).
+
+// Vulkan format numbers stored in the header
+const uint32_t KTX2_VK_FORMAT_BC1_RGB_UNORM = 131;
+const uint32_t KTX2_VK_FORMAT_BC3_UNORM = 137;
+const uint32_t KTX2_VK_FORMAT_BC7_UNORM = 145;
+
+struct Ktx2Image {
+    uint32_t vkFormat;
+    uint32_t width, height;
+    std::vector<std::vector<unsigned char> > levels; // level 0 (full size) first
+};
+
+// bytes per 4x4 block, 0 for formats this reader does not know
+inline unsigned int ktx2BlockBytes(uint32_t vkFormat)
+{
+    switch (vkFormat)
+    {
+    case KTX2_VK_FORMAT_BC1_RGB_UNORM:
+        return 8;
+    case KTX2_VK_FORMAT_BC3_UNORM:
+    case KTX2_VK_FORMAT_BC7_UNORM:
+        return 16;
+    }
+    return 0;
+}
+
+inline size_t ktx2LevelBytes(uint32_t vkFormat, uint32_t width, uint32_t height)
+{
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * ktx2BlockBytes(vkFormat);
+}
+
+// path of the baked counterpart of an image: the same path with the extension replaced by .ktx2
+inline std::string ktx2Path(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+        return path + ".ktx2";
+    return path.substr(0, dot) + ".ktx2";
+}
+
+inline bool ktx2Exists(const std::string& path)
+{
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (file)
+        std::fclose(file);
+    return file != NULL;
+}
+
+// replaces the paths by their baked counterparts if every one of them has been baked, a texture array or a
+// cubemap is either all compressed or all decoded; returns whether they were replaced
+inline bool preferKtx2(std::vector<std::string>& paths)
+{
+    for (unsigned int i = 0; i < paths.size(); i++)
+        if (!ktx2Exists(ktx2Path(paths[i])))
+            return false;
+    for (unsigned int i = 0; i < paths.size(); i++)
+        paths[i] = ktx2Path(paths[i]);
+    return !paths.empty();
+}
+
+namespace ktx2
+{
+    const unsigned char IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+    const unsigned int HEADER_BYTES = 80; // identifier, header and index
+    const unsigned int LEVEL_INDEX_BYTES = 24;
+
+    struct Header {
+        uint32_t vkFormat, typeSize, pixelWidth, pixelHeight, pixelDepth, layerCount, faceCount, levelCount, supercompressionScheme;
+        uint32_t dfdByteOffset, dfdByteLength, kvdByteOffset, kvdByteLength;
+        uint64_t sgdByteOffset, sgdByteLength;
+    };
+
+    inline void put32(std::vector<unsigned char>& out, uint32_t value)
+    {
+        for (unsigned int i = 0; i < 4; i++)
+            out.push_back((unsigned char)(value >> (8 * i)));
+    }
+
+    inline void put64(std::vector<unsigned char>& out, uint64_t value)
+    {
+        put32(out, (uint32_t)value);
+        put32(out, (uint32_t)(value >> 32));
+    }
+
+    inline uint32_t get32(const unsigned char* in)
+    {
+        return in[0] | (in[1] << 8) | (in[2] << 16) | ((uint32_t)in[3] << 24);
+    }
+
+    inline uint64_t get64(const unsigned char* in)
+    {
+        return get32(in) | ((uint64_t)get32(in + 4) << 32);
+    }
+
+    // basic data format descriptor of a BC format (KHR_DF_MODEL_BC1A/BC3/BC7, BT.709 primaries, linear)
+    inline std::vector<unsigned char> dataFormatDescriptor(uint32_t vkFormat)
+    {
+        struct Sample {
+            uint32_t bitOffset, bitLength, channel;
+        };
+        uint32_t model;
+        std::vector<Sample> samples;
+        if (vkFormat == KTX2_VK_FORMAT_BC1_RGB_UNORM)
+        {
+            model = 128;
+            Sample color = { 0, 64, 0 };
+            samples.push_back(color);
+        }
+        else if (vkFormat == KTX2_VK_FORMAT_BC3_UNORM)
+        {
+            model = 130;
+            Sample alpha = { 0, 64, 15 };
+            Sample color = { 64, 64, 0 };
+            samples.push_back(alpha);
+            samples.push_back(color);
+        }
+        else
+        {
+            model = 134;
+            Sample color = { 0, 128, 0 };
+            samples.push_back(color);
+        }
+        uint32_t blockSize = 24 + 16 * samples.size();
+        std::vector<unsigned char> dfd;
+        put32(dfd, 4 + blockSize);               // dfdTotalSize
+        put32(dfd, 0);                           // vendor Khronos, descriptor type basic
+        put32(dfd, (blockSize << 16) | 2);       // version 1.3
+        put32(dfd, model | (1 << 8) | (1 << 16)); // BT.709 primaries, linear transfer, straight alpha
+        put32(dfd, 3 | (3 << 8));                // 4x4x1x1 texel blocks
+        put32(dfd, ktx2BlockBytes(vkFormat));    // bytes per plane 0
+        put32(dfd, 0);
+        for (unsigned int i = 0; i < samples.size(); i++)
+        {
+            put32(dfd, samples[i].bitOffset | ((samples[i].bitLength - 1) << 16) | (samples[i].channel << 24));
+            put32(dfd, 0);          // sample position
+            put32(dfd, 0);          // lower
+            put32(dfd, 0xFFFFFFFF); // upper
+        }
+        return dfd;
+    }
+
+    inline bool readHeader(FILE* file, const std::string& path, Header& header)
+    {
+        unsigned char bytes[HEADER_BYTES];
+        if (std::fread(bytes, 1, HEADER_BYTES, file) != HEADER_BYTES || std::memcmp(bytes, IDENTIFIER, 12) != 0)
+        {
+            std::cout << "ERROR::KTX2::NOT_A_KTX2_FILE: " << path << std::endl;
+            return false;
+        }
+        uint32_t* const fields[13] = {
+            &header.vkFormat, &header.typeSize, &header.pixelWidth, &header.pixelHeight, &header.pixelDepth,
+            &header.layerCount, &header.faceCount, &header.levelCount, &header.supercompressionScheme,
+            &header.dfdByteOffset, &header.dfdByteLength, &header.kvdByteOffset, &header.kvdByteLength
+        };
+        for (unsigned int i = 0; i < 13; i++)
+            *fields[i] = get32(bytes + 12 + 4 * i);
+        header.sgdByteOffset = get64(bytes + 64);
+        header.sgdByteLength = get64(bytes + 72);
+        if (!ktx2BlockBytes(header.vkFormat) || header.pixelDepth > 0 || header.layerCount > 0 || header.faceCount != 1 ||
+            header.supercompressionScheme != 0 || header.pixelWidth == 0 || header.pixelHeight == 0)
+        {
+            std::cout << "ERROR::KTX2::UNSUPPORTED: " << path << " (vkFormat " << header.vkFormat << ", " << header.layerCount << " layers, "
+                      << header.faceCount << " faces, supercompression " << header.supercompressionScheme << ")" << std::endl;
+            return false;
+        }
+        if (header.levelCount == 0)
+            header.levelCount = 1;
+        return true;
+    }
+}
+
+// format and size without reading the image data
+inline bool readKtx2Info(const std::string& path, uint32_t& vkFormat, uint32_t& width, uint32_t& height, uint32_t& levels)
+{
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+        return false;
+    ktx2::Header header;
+    bool ok = ktx2::readHeader(file, path, header);
+    std::fclose(file);
+    if (!ok)
+        return false;
+    vkFormat = header.vkFormat;
+    width = header.pixelWidth;
+    height = header.pixelHeight;
+    levels = header.levelCount;
+    return true;
+}
+
+inline bool readKtx2(const std::string& path, Ktx2Image& image)
+{
+    FILE* file = std::fopen(path.c_str(), "rb");
+    if (!file)
+    {
+        std::cout << "ERROR::KTX2::FILE_NOT_SUCCESFULLY_READ: " << path << std::endl;
+        return false;
+    }
+    ktx2::Header header;
+    bool ok = ktx2::readHeader(file, path, header);
+    std::vector<unsigned char> index;
+    if (ok)
+    {
+        index.resize(header.levelCount * ktx2::LEVEL_INDEX_BYTES);
+        ok = std::fread(&index[0], 1, index.size(), file) == index.size();
+    }
+    if (ok)
+    {
+        image.vkFormat = header.vkFormat;
+        image.width = header.pixelWidth;
+        image.height = header.pixelHeight;
+        image.levels.resize(header.levelCount);
+        for (unsigned int i = 0; i < header.levelCount && ok; i++)
+        {
+            uint64_t offset = ktx2::get64(&index[i * ktx2::LEVEL_INDEX_BYTES]);
+            uint64_t length = ktx2::get64(&index[i * ktx2::LEVEL_INDEX_BYTES + 8]);
+            uint32_t levelWidth = std::max(header.pixelWidth >> i, 1u), levelHeight = std::max(header.pixelHeight >> i, 1u);
+            ok = length == ktx2LevelBytes(header.vkFormat, levelWidth, levelHeight);
+            if (ok)
+                image.levels[i].resize(length);
+            ok = ok && std::fseek(file, (long)offset, SEEK_SET) == 0 && std::fread(&image.levels[i][0], 1, length, file) == length;
+        }
+        if (!ok)
+            std::cout << "ERROR::KTX2::TRUNCATED: " << path << std::endl;
+    }
+    std::fclose(file);
+    return ok;
+}
+
+// levels must hold the whole mip chain or a prefix of it, level 0 first
+inline bool writeKtx2(const std::string& path, const Ktx2Image& image)
+{
+    uint32_t levelCount = image.levels.size();
+    unsigned int alignment = ktx2BlockBytes(image.vkFormat); // lcm(block bytes, 4)
+    std::vector<unsigned char> dfd = ktx2::dataFormatDescriptor(image.vkFormat);
+    std::vector<unsigned char> kvd;
+    const char KEY[] = "KTXwriter";
+    const char VALUE[] = "SolarSystem TextureBaker";
+    ktx2::put32(kvd, sizeof(KEY) + sizeof(VALUE));
+    kvd.insert(kvd.end(), KEY, KEY + sizeof(KEY));
+    kvd.insert(kvd.end(), VALUE, VALUE + sizeof(VALUE));
+    while (kvd.size() % 4)
+        kvd.push_back(0);
+
+    uint32_t dfdOffset = ktx2::HEADER_BYTES + levelCount * ktx2::LEVEL_INDEX_BYTES;
+    uint32_t kvdOffset = dfdOffset + dfd.size();
+    uint64_t dataOffset = kvdOffset + kvd.size();
+
+    // the spec orders the level data from the smallest level to the largest
+    std::vector<uint64_t> levelOffset(levelCount);
+    for (unsigned int i = levelCount; i-- > 0;)
+    {
+        dataOffset = (dataOffset + alignment - 1) / alignment * alignment;
+        levelOffset[i] = dataOffset;
+        dataOffset += image.levels[i].size();
+    }
+
+    std::vector<unsigned char> out(ktx2::IDENTIFIER, ktx2::IDENTIFIER + 12);
+    ktx2::put32(out, image.vkFormat);
+    ktx2::put32(out, 1); // typeSize of block-compressed formats
+    ktx2::put32(out, image.width);
+    ktx2::put32(out, image.height);
+    ktx2::put32(out, 0); // depth
+    ktx2::put32(out, 0); // layers
+    ktx2::put32(out, 1); // faces
+    ktx2::put32(out, levelCount);
+    ktx2::put32(out, 0); // no supercompression
+    ktx2::put32(out, dfdOffset);
+    ktx2::put32(out, dfd.size());
+    ktx2::put32(out, kvdOffset);
+    ktx2::put32(out, kvd.size());
+    ktx2::put64(out, 0); // no supercompression global data
+    ktx2::put64(out, 0);
+    for (unsigned int i = 0; i < levelCount; i++)
+    {
+        ktx2::put64(out, levelOffset[i]);
+        ktx2::put64(out, image.levels[i].size());
+        ktx2::put64(out, image.levels[i].size());
+    }
+    out.insert(out.end(), dfd.begin(), dfd.end());
+    out.insert(out.end(), kvd.begin(), kvd.end());
+    for (unsigned int i = levelCount; i-- > 0;)
+    {
+        out.resize(levelOffset[i], 0);
+        out.insert(out.end(), image.levels[i].begin(), image.levels[i].end());
+    }
+
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file || std::fwrite(&out[0], 1, out.size(), file) != out.size())
+    {
+        std::cout << "ERROR::KTX2::FILE_NOT_SUCCESFULLY_WRITTEN: " << path << std::endl;
+        if (file)
+            std::fclose(file);
+        return false;
+    }
+    std::fclose(file);
+    return true;
+}
+#endif
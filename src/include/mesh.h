@@ -8,6 +8,8 @@
 #include <string>
 #include <vector>
 #include "shader.h"
+#include "gl_state.h"
+#include "gpu_memory.h"
 
 using namespace std;
 
@@ -44,22 +46,15 @@ public:
         this->vertices = vertices;
         this->indices = indices;
         this->textures = textures;
+        samplerProgram = 0;
 
-        // now that we have all the required data, set the vertex buffers and its attribute pointers.
-        setupMesh();
-    }
-
-    // render the mesh
-    void Draw(Shader &shader) 
-    {
-        // bind appropriate textures
+        // sampler names ("texture_diffuseN" and so on) only depend on the textures
         unsigned int diffuseNr  = 1;
         unsigned int specularNr = 1;
         unsigned int normalNr   = 1;
         unsigned int heightNr   = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
-            glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
             string name = textures[i].type;
@@ -71,25 +66,46 @@ public:
                 number = std::to_string(normalNr++);  // transfer unsigned int to stream
             else if(name == "texture_height")
                 number = std::to_string(heightNr++);  // transfer unsigned int to stream
+            samplerNames.push_back(name + number);
+        }
+
+        // now that we have all the required data, set the vertex buffers and its attribute pointers.
+        setupMesh();
+    }
 
+    // render the mesh
+    void Draw(Shader &shader) 
+    {
+        // resolve the sampler handles when drawn with a different program than last time
+        if(shader.ID != samplerProgram)
+        {
+            samplers.clear();
+            for(unsigned int i = 0; i < samplerNames.size(); i++)
+                samplers.push_back(shader.uniform<int>(samplerNames[i].c_str()));
+            samplerProgram = shader.ID;
+        }
+        // bind appropriate textures
+        for(unsigned int i = 0; i < textures.size(); i++)
+        {
+            glState().activeTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // now set the sampler to the correct texture unit
-            glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);
+            samplers[i].set(i);
             // and finally bind the texture
-            glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            glState().bindTexture(GL_TEXTURE_2D, textures[i].id);
         }
         
-        // draw mesh
-        glBindVertexArray(VAO);
+        // draw mesh. The state cache tracks what is bound, so nothing is reset afterwards
+        glState().bindVertexArray(VAO);
         glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
 private:
     // render data 
     unsigned int VBO, EBO;
+    // sampler uniform of each texture, resolved for samplerProgram
+    vector<string> samplerNames;
+    vector<Uniform<int> > samplers;
+    unsigned int samplerProgram;
 
     // initializes all the buffer objects/arrays
     void setupMesh()
@@ -99,7 +115,7 @@ private:
         glGenBuffers(1, &VBO);
         glGenBuffers(1, &EBO);
 
-        glBindVertexArray(VAO);
+        glState().bindVertexArray(VAO);
         // load data into vertex buffers
         glBindBuffer(GL_ARRAY_BUFFER, VBO);
         // A great thing about structs is that their memory layout is sequential for all its items.
@@ -109,6 +125,10 @@ private:
 
         glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+        // counted to the model being loaded, see GpuAssetScope
+        gpuMemory().allocate(GpuMemory::BUFFER, VBO, GPU_MEMORY_MESHES, "", vertices.size() * sizeof(Vertex));
+        gpuMemory().allocate(GpuMemory::BUFFER, EBO, GPU_MEMORY_MESHES, "", indices.size() * sizeof(unsigned int));
+        gpuMemory().uploaded(vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int));
 
         // set the vertex attribute pointers
         // vertex Positions
@@ -127,7 +147,7 @@ private:
         glEnableVertexAttribArray(4);
         glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, Bitangent));
 
-        glBindVertexArray(0);
+        glState().bindVertexArray(0);
     }
 };
 #endif
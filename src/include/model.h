@@ -11,6 +11,10 @@
 
 #include "shader.h"
 #include "mesh.h"
+#include "gpu_memory.h"
+#include "render_queue.h"
+#include "trace.h"
+#include "texture_residency.h"
 #include <string>
 #include <fstream>
 #include <sstream>
@@ -43,11 +47,49 @@ public:
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
+
+    // records one opaque command per mesh instead of drawing right away, keyed by the program, the mesh's
+    // first texture and the model's distance from the camera
+    void Draw(Shader &shader, RenderQueue &queue, float distance, float farPlane)
+    {
+        uint32_t depth = RenderQueue::depthBits(distance, farPlane);
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            unsigned int material = meshes[i].textures.empty() ? 0 : meshes[i].textures[0].id;
+            queue.submit(PASS_OPAQUE, shader.ID, material, depth, drawMesh, &meshes[i], &shader);
+        }
+    }
+
+    // hands the model's textures to a residency manager, which may then drop and restore their finest mips
+    void trackTextures(TextureResidency &residency) const
+    {
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+            residency.track(textures_loaded[i].id, directory + '/' + textures_loaded[i].path);
+    }
+
+    // reports the model's textures as drawn this frame within the given bounding sphere
+    void useTextures(TextureResidency &residency, const glm::vec3 &center, float radius) const
+    {
+        for(unsigned int i = 0; i < textures_loaded.size(); i++)
+            residency.use(textures_loaded[i].id, center, radius);
+    }
     
 private:
+    // MicroBenchmarks times processMesh on synthetic meshes
+    friend class ModelBenchmark;
+    Model() : gammaCorrection(false) {}
+
+    // RenderQueue callback of a mesh submitted by Draw
+    static void drawMesh(void* mesh, void* shader)
+    {
+        static_cast<Mesh*>(mesh)->Draw(*static_cast<Shader*>(shader));
+    }
+
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
+        TraceScope trace("Model import", Trace::intern(path.c_str()));
+        GpuAssetScope asset(path);
         // read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_GenSmoothNormals | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -204,6 +246,7 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
 {
     string filename = string(path);
     filename = directory + '/' + filename;
+    TraceScope trace("TextureFromFile", Trace::intern(filename.c_str()));
 
     unsigned int textureID;
     glGenTextures(1, &textureID);
@@ -223,9 +266,12 @@ unsigned int TextureFromFile(const char *path, const string &directory, bool gam
             format = GL_RGBA;
         }
 
-        glBindTexture(GL_TEXTURE_2D, textureID);
+        glState().bindTexture(GL_TEXTURE_2D, textureID);
         glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        gpuMemory().allocate(GpuMemory::TEXTURE, textureID, GPU_MEMORY_TEXTURES, filename,
+                             GpuMemory::textureBytes(format, width, height, 1, GpuMemory::mipLevels(width, height)));
+        gpuMemory().uploaded((size_t)width * height * nrComponents);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
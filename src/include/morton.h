@@ -0,0 +1,126 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <algorithm>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Z-order (Morton) codes and a parallel radix sort, used to keep particles that are close in space
+// close in memory as well.
+
+// spreads the low 10 bits of v so that there are two zero bits between each of them
+inline uint32_t mortonSpread(uint32_t v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+// 30 bit Morton code of a cell in a 1024^3 grid
+inline uint32_t mortonCode(uint32_t x, uint32_t y, uint32_t z)
+{
+    return mortonSpread(x) | (mortonSpread(y) << 1) | (mortonSpread(z) << 2);
+}
+
+// Stable LSD radix sort of keys (and their values alongside), 8 bits per pass. Every pass splits the
+// array into one chunk per thread: the threads build per-chunk histograms, a prefix sum turns them into
+// per-chunk output offsets, and the threads then scatter their chunks independently.
+inline void parallelRadixSort(std::vector<uint32_t>& keys, std::vector<uint32_t>& values, unsigned int keyBits, unsigned int threads)
+{
+    const unsigned int RADIX_BITS = 8;
+    const unsigned int BUCKETS = 1 << RADIX_BITS;
+    size_t n = keys.size();
+    threads = std::max(1u, std::min(threads, (unsigned int)(n / 4096 + 1)));
+
+    std::vector<uint32_t> keysOut(n), valuesOut(n);
+    std::vector<size_t> offsets(threads * BUCKETS);
+    std::vector<std::thread> workers;
+    for (unsigned int shift = 0; shift < keyBits; shift += RADIX_BITS)
+    {
+        // 1. per-chunk histograms
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            workers.push_back(std::thread([&, t, shift]() {
+                size_t* histogram = &offsets[t * BUCKETS];
+                std::fill(histogram, histogram + BUCKETS, 0);
+                for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++)
+                    histogram[(keys[i] >> shift) & (BUCKETS - 1)]++;
+            }));
+        }
+        for (unsigned int t = 0; t < threads; t++)
+            workers[t].join();
+        workers.clear();
+
+        // 2. exclusive prefix sum, digit major then chunk, keeps the sort stable
+        size_t sum = 0;
+        for (unsigned int d = 0; d < BUCKETS; d++)
+        {
+            for (unsigned int t = 0; t < threads; t++)
+            {
+                size_t count = offsets[t * BUCKETS + d];
+                offsets[t * BUCKETS + d] = sum;
+                sum += count;
+            }
+        }
+
+        // 3. scatter
+        for (unsigned int t = 0; t < threads; t++)
+        {
+            workers.push_back(std::thread([&, t, shift]() {
+                size_t* offset = &offsets[t * BUCKETS];
+                for (size_t i = n * t / threads; i < n * (t + 1) / threads; i++)
+                {
+                    size_t destination = offset[(keys[i] >> shift) & (BUCKETS - 1)]++;
+                    keysOut[destination] = keys[i];
+                    valuesOut[destination] = values[i];
+                }
+            }));
+        }
+        for (unsigned int t = 0; t < threads; t++)
+            workers[t].join();
+        workers.clear();
+
+        keys.swap(keysOut);
+        values.swap(valuesOut);
+    }
+}
+
+// Order of the points [begin, end) along the Z-order curve through their bounding box. Points before
+// begin keep their place. The result is suitable for NBodySystem::permute.
+inline std::vector<unsigned int> mortonOrder(const float* px, const float* py, const float* pz, unsigned int begin, unsigned int end, unsigned int threads)
+{
+    std::vector<unsigned int> order(end);
+    for (unsigned int i = 0; i < begin; i++)
+        order[i] = i;
+    if (end <= begin)
+        return order;
+
+    float lo[3] = { px[begin], py[begin], pz[begin] };
+    float hi[3] = { px[begin], py[begin], pz[begin] };
+    for (unsigned int i = begin; i < end; i++)
+    {
+        lo[0] = std::min(lo[0], px[i]); hi[0] = std::max(hi[0], px[i]);
+        lo[1] = std::min(lo[1], py[i]); hi[1] = std::max(hi[1], py[i]);
+        lo[2] = std::min(lo[2], pz[i]); hi[2] = std::max(hi[2], pz[i]);
+    }
+    // one uniform cell size for all axes keeps the cells cubic
+    float extent = std::max(hi[0] - lo[0], std::max(hi[1] - lo[1], hi[2] - lo[2]));
+    float toCell = extent > 0.0f ? 1023.0f / extent : 0.0f;
+
+    std::vector<uint32_t> keys(end - begin), values(end - begin);
+    for (unsigned int i = begin; i < end; i++)
+    {
+        keys[i - begin] = mortonCode((uint32_t)((px[i] - lo[0]) * toCell),
+                                     (uint32_t)((py[i] - lo[1]) * toCell),
+                                     (uint32_t)((pz[i] - lo[2]) * toCell));
+        values[i - begin] = i;
+    }
+    parallelRadixSort(keys, values, 30, threads);
+    std::copy(values.begin(), values.end(), order.begin() + begin);
+    return order;
+}
+#endif
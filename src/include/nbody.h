@@ -0,0 +1,209 @@
+#ifndef NBODY_H
+#define NBODY_H
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#endif
+
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <vector>
+
+#include "orbit.h"
+#include "morton.h"
+
+// Gravitational N-body simulation of the sun, the planets and an asteroid belt.
+//
+// Unlike the kinematic orbits in orbit.h, bodies here attract each other. The system is seeded from
+// BODIES: every planet starts on a circular orbit at its orbit radius. Units are scene units, simulation
+// days and G = 1.
+const float NBODY_SUN_MASS = 1000.0f;
+const float NBODY_BELT_INNER = 21.0f;
+const float NBODY_BELT_OUTER = 24.0f;
+
+class NBodySystem
+{
+public:
+    // structure of arrays, one entry per body. Index 0 is the sun, 1..BODY_COUNT-1 the planets.
+    float* px;
+    float* py;
+    float* pz;
+    float* vx;
+    float* vy;
+    float* vz;
+    float* mass;
+    unsigned int count;
+    float softening;
+    // every resortInterval steps, step() reorders the belt particles along a Z-order curve so that
+    // spatial neighbours are memory neighbours (0 = never). DomainDecomposition orders by angle instead.
+    unsigned int resortInterval;
+
+    // shared = true places the arrays in memory that stays shared with processes forked afterwards
+    NBodySystem(unsigned int beltParticles, bool shared = false, unsigned int seed = 1)
+        : count(BODY_COUNT + beltParticles), softening(0.05f), resortInterval(0), shared(shared), steps(0)
+    {
+        bytes = 7 * count * sizeof(float);
+#ifndef _WIN32
+        if (shared)
+        {
+            void* memory = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+            data = memory == MAP_FAILED ? NULL : (float*)memory;
+        }
+        else
+#endif
+            data = (float*)malloc(bytes);
+        if (!data)
+        {
+            count = 0;
+            return;
+        }
+        px = data;
+        py = px + count;
+        pz = py + count;
+        vx = pz + count;
+        vy = vx + count;
+        vz = vy + count;
+        mass = vz + count;
+        init(seed);
+    }
+
+    ~NBodySystem()
+    {
+#ifndef _WIN32
+        if (shared)
+        {
+            if (data)
+                munmap(data, bytes);
+            return;
+        }
+#endif
+        free(data);
+    }
+
+    // accelerations of bodies [begin, end) by direct summation over all bodies
+    void accelerations(unsigned int begin, unsigned int end, float* ax, float* ay, float* az) const
+    {
+        for (unsigned int i = begin; i < end; i++)
+        {
+            float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+            accumulate(px[i], py[i], pz[i], 0, count, sx, sy, sz);
+            ax[i - begin] = sx;
+            ay[i - begin] = sy;
+            az[i - begin] = sz;
+        }
+    }
+
+    // adds the pull of bodies [begin, end) on the point (x, y, z) to (sx, sy, sz)
+    void accumulate(float x, float y, float z, unsigned int begin, unsigned int end, float& sx, float& sy, float& sz) const
+    {
+        float eps2 = softening * softening;
+        for (unsigned int j = begin; j < end; j++)
+        {
+            float dx = px[j] - x;
+            float dy = py[j] - y;
+            float dz = pz[j] - z;
+            float r2 = dx * dx + dy * dy + dz * dz + eps2;
+            float inv = 1.0f / sqrtf(r2);
+            float s = mass[j] * inv * inv * inv;
+            sx += dx * s;
+            sy += dy * s;
+            sz += dz * s;
+        }
+    }
+
+    // semi-implicit Euler update of bodies [begin, end) from their accelerations
+    void integrate(unsigned int begin, unsigned int end, const float* ax, const float* ay, const float* az, float dt)
+    {
+        for (unsigned int i = begin; i < end; i++)
+        {
+            vx[i] += ax[i - begin] * dt;
+            vy[i] += ay[i - begin] * dt;
+            vz[i] += az[i - begin] * dt;
+            px[i] += vx[i] * dt;
+            py[i] += vy[i] * dt;
+            pz[i] += vz[i] * dt;
+        }
+    }
+
+    // single process reference step
+    void step(float dt)
+    {
+        if (resortInterval > 0 && steps % resortInterval == 0)
+            resort();
+        steps++;
+        ax.resize(count);
+        ay.resize(count);
+        az.resize(count);
+        accelerations(0, count, &ax[0], &ay[0], &az[0]);
+        integrate(0, count, &ax[0], &ay[0], &az[0], dt);
+    }
+
+    // Morton re-sort of the belt particles, radix sorted on all hardware threads
+    void resort()
+    {
+        permute(mortonOrder(px, py, pz, BODY_COUNT, count, std::max(1u, std::thread::hardware_concurrency())));
+    }
+
+    // reorders all bodies so that new index i holds the body previously at order[i].
+    // Callers keep the sun and planets (indices below BODY_COUNT) in place.
+    void permute(const std::vector<unsigned int>& order)
+    {
+        std::vector<float> scratch(count);
+        float* arrays[7] = { px, py, pz, vx, vy, vz, mass };
+        for (unsigned int a = 0; a < 7; a++)
+        {
+            for (unsigned int i = 0; i < count; i++)
+                scratch[i] = arrays[a][order[i]];
+            memcpy(arrays[a], &scratch[0], count * sizeof(float));
+        }
+    }
+
+private:
+    bool shared;
+    unsigned int steps;
+    size_t bytes;
+    float* data;
+    std::vector<float> ax, ay, az;
+
+    void init(unsigned int seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            float radius, height = 0.0f, bodyMass;
+            if (i == SUN)
+            {
+                radius = 0.0f;
+                bodyMass = NBODY_SUN_MASS;
+            }
+            else if (i < BODY_COUNT)
+            {
+                radius = BODIES[i].orbitRadius;
+                // mass grows with volume, a planet of scale 1 weighs a thousandth of the sun
+                bodyMass = BODIES[i].scale * BODIES[i].scale * BODIES[i].scale;
+            }
+            else
+            {
+                radius = NBODY_BELT_INNER + (NBODY_BELT_OUTER - NBODY_BELT_INNER) * unit(random);
+                height = 0.2f * (unit(random) - 0.5f);
+                bodyMass = 1.0e-6f;
+            }
+            float angle = 2.0f * 3.14159265359f * unit(random);
+            float speed = radius > 0.0f ? sqrtf(NBODY_SUN_MASS / radius) : 0.0f;
+            px[i] = radius * cos(angle);
+            py[i] = height;
+            pz[i] = radius * sin(angle);
+            vx[i] = -speed * sin(angle);
+            vy[i] = 0.0f;
+            vz[i] = speed * cos(angle);
+            mass[i] = bodyMass;
+        }
+    }
+
+    NBodySystem(const NBodySystem&);
+    NBodySystem& operator=(const NBodySystem&);
+};
+#endif
@@ -0,0 +1,290 @@
+#ifndef NBODY_DOMAIN_H
+#define NBODY_DOMAIN_H
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "nbody.h"
+
+// MPI-like group of ranks on one machine. The constructor prepares a process-shared barrier, spawn()
+// forks the other ranks and returns the rank of the calling process, finish() ends every rank but 0.
+// Memory mapped MAP_SHARED before spawn() (see NBodySystem) is visible to all ranks.
+class Communicator
+{
+public:
+    Communicator(int size) : rankId(0), rankCount(size)
+    {
+        barrierState = (pthread_barrier_t*)mmap(NULL, sizeof(pthread_barrier_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        pthread_barrierattr_t attributes;
+        pthread_barrierattr_init(&attributes);
+        pthread_barrierattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_barrier_init(barrierState, &attributes, size);
+        pthread_barrierattr_destroy(&attributes);
+    }
+
+    ~Communicator()
+    {
+        if (rankId == 0)
+        {
+            pthread_barrier_destroy(barrierState);
+            munmap(barrierState, sizeof(pthread_barrier_t));
+        }
+    }
+
+    // forks ranks 1..size-1; every process continues from here with its own rank
+    int spawn()
+    {
+        for (int r = 1; r < rankCount; r++)
+        {
+            pid_t pid = fork();
+            if (pid == 0)
+            {
+                rankId = r;
+                children.clear();
+                return r;
+            }
+            children.push_back(pid);
+        }
+        return 0;
+    }
+
+    // ranks other than 0 exit here, rank 0 waits for all of them
+    void finish()
+    {
+        if (rankId != 0)
+            _exit(0);
+        for (unsigned int i = 0; i < children.size(); i++)
+            waitpid(children[i], NULL, 0);
+        children.clear();
+    }
+
+    void barrier()
+    {
+        pthread_barrier_wait(barrierState);
+    }
+
+    int rank() const
+    {
+        return rankId;
+    }
+
+    int size() const
+    {
+        return rankCount;
+    }
+
+private:
+    int rankId;
+    int rankCount;
+    pthread_barrier_t* barrierState;
+    std::vector<pid_t> children;
+};
+
+// Summary of one domain, published to the other ranks every step.
+// Quadrupole is the traceless tensor sum m (3 d d^T - |d|^2 I), stored as xx, yy, zz, xy, xz, yz.
+struct DomainMultipole {
+    float mass;
+    float com[3];
+    float quadrupole[6];
+    float radius;
+    unsigned int begin;
+    unsigned int end;
+};
+
+// Spatial domain decomposition of an NBodySystem across the ranks of a Communicator.
+//
+// The sun and planets are few and heavy, so their pull is summed directly by every rank and rank 0
+// integrates them. Belt particles are sorted by their angle around the sun every rebalanceInterval steps
+// and split into domainCount equal wedges of the belt (one per rank by default); each rank owns a
+// contiguous group of wedges. A particle's own wedge is summed directly. For every other wedge the
+// published multipole is used if the wedge is far enough away (radius < theta * distance), otherwise
+// that wedge's particles are read straight from shared memory.
+//
+// The approximation depends only on the wedges, not on which rank owns them, so runs with the same
+// domainCount do the same work at any number of ranks.
+class DomainDecomposition
+{
+public:
+    unsigned long long directInteractions;
+    unsigned long long multipoleInteractions;
+
+    // domainCount 0: one wedge per rank; never fewer wedges than ranks
+    DomainDecomposition(NBodySystem& system, int ranks, int domainCount = 0, float theta = 0.5f, unsigned int rebalanceInterval = 10)
+        : directInteractions(0), multipoleInteractions(0), system(system), ranks(ranks), domainCount(std::max(domainCount, ranks)),
+          theta(theta), rebalanceInterval(rebalanceInterval), steps(0)
+    {
+        domains = (DomainMultipole*)mmap(NULL, this->domainCount * sizeof(DomainMultipole), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        unsigned int particles = system.count - BODY_COUNT;
+        for (int d = 0; d < this->domainCount; d++)
+        {
+            domains[d].begin = BODY_COUNT + (unsigned int)((unsigned long long)particles * d / this->domainCount);
+            domains[d].end = BODY_COUNT + (unsigned int)((unsigned long long)particles * (d + 1) / this->domainCount);
+        }
+    }
+
+    ~DomainDecomposition()
+    {
+        munmap(domains, domainCount * sizeof(DomainMultipole));
+    }
+
+    // advances the system by dt; every rank of comm must call this
+    void step(Communicator& comm, float dt)
+    {
+        int rank = comm.rank();
+        if (steps++ % rebalanceInterval == 0)
+        {
+            if (rank == 0)
+                sortParticles();
+            comm.barrier();
+        }
+
+        int first = firstDomain(rank), last = firstDomain(rank + 1);
+        for (int d = first; d < last; d++)
+            computeMultipole(d);
+        comm.barrier();
+
+        unsigned int begin = domains[first].begin, end = domains[last - 1].end;
+        unsigned int count = end - begin;
+        ax.resize(count + BODY_COUNT);
+        ay.resize(count + BODY_COUNT);
+        az.resize(count + BODY_COUNT);
+        for (int own = first; own < last; own++)
+            for (unsigned int i = domains[own].begin; i < domains[own].end; i++)
+            {
+                float x = system.px[i], y = system.py[i], z = system.pz[i];
+                float sx = 0.0f, sy = 0.0f, sz = 0.0f;
+                system.accumulate(x, y, z, 0, BODY_COUNT, sx, sy, sz);
+                for (int d = 0; d < domainCount; d++)
+                {
+                    const DomainMultipole& domain = domains[d];
+                    float dx = x - domain.com[0], dy = y - domain.com[1], dz = z - domain.com[2];
+                    float r2 = dx * dx + dy * dy + dz * dz;
+                    if (d != own && domain.radius * domain.radius < theta * theta * r2)
+                    {
+                        addMultipole(domain, dx, dy, dz, r2, sx, sy, sz);
+                        multipoleInteractions++;
+                    }
+                    else
+                    {
+                        system.accumulate(x, y, z, domain.begin, domain.end, sx, sy, sz);
+                        directInteractions += domain.end - domain.begin;
+                    }
+                }
+                ax[i - begin] = sx;
+                ay[i - begin] = sy;
+                az[i - begin] = sz;
+            }
+        if (rank == 0)
+            system.accelerations(0, BODY_COUNT, &ax[count], &ay[count], &az[count]);
+        comm.barrier();
+
+        system.integrate(begin, end, &ax[0], &ay[0], &az[0], dt);
+        if (rank == 0)
+            system.integrate(0, BODY_COUNT, &ax[count], &ay[count], &az[count], dt);
+        comm.barrier();
+    }
+
+private:
+    NBodySystem& system;
+    int ranks;
+    int domainCount;
+    float theta;
+    unsigned int rebalanceInterval;
+    unsigned int steps;
+    DomainMultipole* domains;
+    std::vector<float> ax, ay, az;
+
+    struct CompareAngle {
+        const float* angle;
+        bool operator()(unsigned int a, unsigned int b) const { return angle[a] < angle[b]; }
+    };
+
+    // the wedges of a rank are firstDomain(rank) up to firstDomain(rank + 1)
+    int firstDomain(int rank) const
+    {
+        return (int)((long long)domainCount * rank / ranks);
+    }
+
+    // orders the belt particles by angle around the sun so that every domain's index range is a wedge
+    void sortParticles()
+    {
+        std::vector<unsigned int> order(system.count);
+        std::vector<float> angle(system.count);
+        for (unsigned int i = 0; i < system.count; i++)
+        {
+            order[i] = i;
+            angle[i] = atan2f(system.pz[i], system.px[i]);
+        }
+        CompareAngle compare = { &angle[0] };
+        std::sort(order.begin() + BODY_COUNT, order.end(), compare);
+        system.permute(order);
+    }
+
+    void computeMultipole(int d)
+    {
+        DomainMultipole& domain = domains[d];
+        double mass = 0.0, cx = 0.0, cy = 0.0, cz = 0.0;
+        for (unsigned int i = domain.begin; i < domain.end; i++)
+        {
+            mass += system.mass[i];
+            cx += system.mass[i] * system.px[i];
+            cy += system.mass[i] * system.py[i];
+            cz += system.mass[i] * system.pz[i];
+        }
+        if (mass > 0.0)
+        {
+            cx /= mass;
+            cy /= mass;
+            cz /= mass;
+        }
+
+        double q[6] = { 0.0, 0.0, 0.0, 0.0, 0.0, 0.0 };
+        float radius2 = 0.0f;
+        for (unsigned int i = domain.begin; i < domain.end; i++)
+        {
+            double dx = system.px[i] - cx, dy = system.py[i] - cy, dz = system.pz[i] - cz;
+            double d2 = dx * dx + dy * dy + dz * dz;
+            double m = system.mass[i];
+            q[0] += m * (3.0 * dx * dx - d2);
+            q[1] += m * (3.0 * dy * dy - d2);
+            q[2] += m * (3.0 * dz * dz - d2);
+            q[3] += m * 3.0 * dx * dy;
+            q[4] += m * 3.0 * dx * dz;
+            q[5] += m * 3.0 * dy * dz;
+            radius2 = std::max(radius2, (float)d2);
+        }
+
+        domain.mass = (float)mass;
+        domain.com[0] = (float)cx;
+        domain.com[1] = (float)cy;
+        domain.com[2] = (float)cz;
+        for (unsigned int k = 0; k < 6; k++)
+            domain.quadrupole[k] = (float)q[k];
+        domain.radius = sqrtf(radius2);
+    }
+
+    // a = -M d / r^3 + Q d / r^5 - 5/2 (d^T Q d) d / r^7, with d pointing from the domain's center of mass
+    static void addMultipole(const DomainMultipole& domain, float dx, float dy, float dz, float r2, float& sx, float& sy, float& sz)
+    {
+        const float* q = domain.quadrupole;
+        float inv2 = 1.0f / r2;
+        float inv = sqrtf(inv2);
+        float inv3 = inv * inv2;
+        float inv5 = inv3 * inv2;
+        float qx = q[0] * dx + q[3] * dy + q[4] * dz;
+        float qy = q[3] * dx + q[1] * dy + q[5] * dz;
+        float qz = q[4] * dx + q[5] * dy + q[2] * dz;
+        float dqd = dx * qx + dy * qy + dz * qz;
+        float radial = -domain.mass * inv3 - 2.5f * dqd * inv5 * inv2;
+        sx += radial * dx + qx * inv5;
+        sy += radial * dy + qy * inv5;
+        sz += radial * dz + qz * inv5;
+    }
+};
+#endif
@@ -0,0 +1,129 @@
+#ifndef NBODY_GPU_H
+#define NBODY_GPU_H
+
+#include <glad/glad.h>
+
+#include <vector>
+
+#include "compute_shader.h"
+#include "gpu_memory.h"
+#include "nbody.h"
+#include "frame_allocator.h"
+
+// GPU side of the N-body simulation.
+//
+// Body positions (xyz, mass in w) live in a pair of shader storage buffers. The compute backend steps
+// the simulation entirely on the GPU with shader/nbody.comp, ping-ponging between the two buffers, so
+// positions never travel back to the CPU. The CPU backends instead upload() their positions into the
+// frame allocator every frame. Either way bindPositions() exposes the latest positions to
+// shader/nbodySphere.vert.
+class NBodyGpu
+{
+public:
+    unsigned int count;
+
+    NBodyGpu(const NBodySystem& system) : count(system.count), current(0), streamBuffer(0), streamOffset(0), streamSize(0), shader("../../src/shader/nbody.comp"), softening(system.softening)
+    {
+        countUniform = shader.uniform<unsigned int>("count");
+        dtUniform = shader.uniform<float>("dt");
+        softeningUniform = shader.uniform<float>("softening");
+
+        std::vector<float> positions(count * 4), velocities(count * 4);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            positions[i * 4 + 0] = system.px[i];
+            positions[i * 4 + 1] = system.py[i];
+            positions[i * 4 + 2] = system.pz[i];
+            positions[i * 4 + 3] = system.mass[i];
+            velocities[i * 4 + 0] = system.vx[i];
+            velocities[i * 4 + 1] = system.vy[i];
+            velocities[i * 4 + 2] = system.vz[i];
+            velocities[i * 4 + 3] = 0.0f;
+        }
+        glGenBuffers(2, positionBuffers);
+        glGenBuffers(1, &velocityBuffer);
+        for (unsigned int b = 0; b < 2; b++)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, positionBuffers[b]);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, positions.size() * sizeof(float), &positions[0], GL_DYNAMIC_DRAW);
+            gpuMemory().allocate(GpuMemory::BUFFER, positionBuffers[b], GPU_MEMORY_SIMULATION, "n-body positions", positions.size() * sizeof(float));
+        }
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, velocityBuffer);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, velocities.size() * sizeof(float), &velocities[0], GL_DYNAMIC_DRAW);
+        gpuMemory().allocate(GpuMemory::BUFFER, velocityBuffer, GPU_MEMORY_SIMULATION, "n-body velocities", velocities.size() * sizeof(float));
+        gpuMemory().uploaded((2 * positions.size() + velocities.size()) * sizeof(float));
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    }
+
+    ~NBodyGpu()
+    {
+        gpuMemory().release(GpuMemory::BUFFER, positionBuffers[0]);
+        gpuMemory().release(GpuMemory::BUFFER, positionBuffers[1]);
+        gpuMemory().release(GpuMemory::BUFFER, velocityBuffer);
+        glDeleteBuffers(2, positionBuffers);
+        glDeleteBuffers(1, &velocityBuffer);
+        glDeleteProgram(shader.ID);
+    }
+
+    // compute backend: one simulation step on the GPU
+    void step(float dt)
+    {
+        shader.use();
+        countUniform.set(count);
+        dtUniform.set(dt);
+        softeningUniform.set(softening);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionBuffers[current]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, positionBuffers[1 - current]);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, velocityBuffer);
+        glDispatchCompute((count + NBODY_TILE_SIZE - 1) / NBODY_TILE_SIZE, 1, 1);
+        // the next step and the sphere shader read what this step wrote
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        current = 1 - current;
+    }
+
+    // CPU backends: stream this frame's positions of the CPU simulation, needed every frame because the
+    // allocation only lives for one frame
+    void upload(const NBodySystem& system, FrameAllocator& allocator)
+    {
+        FrameAllocator::Allocation allocation = allocator.allocateStorage(count * 4 * sizeof(float));
+        if (!allocation.data)
+            return;
+        float* positions = static_cast<float*>(allocation.data);
+        for (unsigned int i = 0; i < count; i++)
+        {
+            positions[i * 4 + 0] = system.px[i];
+            positions[i * 4 + 1] = system.py[i];
+            positions[i * 4 + 2] = system.pz[i];
+            positions[i * 4 + 3] = system.mass[i];
+        }
+        streamBuffer = allocator.buffer();
+        streamOffset = allocation.offset;
+        streamSize = allocation.size;
+    }
+
+    // makes the latest positions available at storage buffer binding 0
+    void bindPositions() const
+    {
+        if (streamSize > 0)
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, streamBuffer, streamOffset, streamSize);
+        else
+            glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, positionBuffers[current]);
+    }
+
+private:
+    // must match TILE_SIZE in nbody.comp
+    static const unsigned int NBODY_TILE_SIZE = 256;
+
+    unsigned int current;
+    unsigned int positionBuffers[2];
+    unsigned int velocityBuffer;
+    // positions streamed by upload(), if any
+    unsigned int streamBuffer;
+    GLintptr streamOffset;
+    GLsizeiptr streamSize;
+    ComputeShader shader;
+    float softening;
+    Uniform<unsigned int> countUniform;
+    Uniform<float> dtUniform, softeningUniform;
+};
+#endif
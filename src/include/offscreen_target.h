@@ -0,0 +1,152 @@
+#ifndef OFFSCREEN_TARGET_H
+#define OFFSCREEN_TARGET_H
+
+#include <glad/glad.h>
+
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gpu_memory.h"
+
+// Framebuffer object with an RGBA8 color and a 24 bit depth renderbuffer, the render target of the
+// headless mode where there is no default framebuffer.
+class OffscreenTarget
+{
+public:
+    unsigned int width, height;
+
+    OffscreenTarget(unsigned int width, unsigned int height) : width(width), height(height)
+    {
+        glGenRenderbuffers(2, renderbuffers);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        for (unsigned int i = 0; i < 2; i++)
+            gpuMemory().allocate(GpuMemory::RENDERBUFFER, renderbuffers[i], GPU_MEMORY_TARGETS, "offscreen target", (size_t)width * height * 4);
+
+        glGenFramebuffers(1, &ID);
+        glBindFramebuffer(GL_FRAMEBUFFER, ID);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::FRAMEBUFFER::NOT_COMPLETE: " << width << "x" << height << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    ~OffscreenTarget()
+    {
+        glDeleteFramebuffers(1, &ID);
+        for (unsigned int i = 0; i < 2; i++)
+            gpuMemory().release(GpuMemory::RENDERBUFFER, renderbuffers[i]);
+        glDeleteRenderbuffers(2, renderbuffers);
+    }
+
+    // makes this the target of all following draws
+    void bind()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, ID);
+        glViewport(0, 0, width, height);
+    }
+
+private:
+    unsigned int ID;
+    unsigned int renderbuffers[2]; // color, depth
+};
+
+// Writes the frames of the bound read framebuffer to binary PPM files named prefix0000.ppm, prefix0001.ppm, ...
+//
+// capture() only starts an asynchronous glReadPixels into one of two pixel buffer objects and writes the frame
+// captured the call before, whose copy has finished by then, so dumping does not stall on every frame.
+class FrameDumper
+{
+public:
+    FrameDumper(const std::string& prefix, unsigned int width, unsigned int height)
+        : prefix(prefix), width(width), height(height), pending(false), pendingIndex(0), next(0)
+    {
+        glGenBuffers(2, pixelBuffers);
+        for (unsigned int i = 0; i < 2; i++)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, (GLsizeiptr)width * height * 4, NULL, GL_STREAM_READ);
+            gpuMemory().allocate(GpuMemory::BUFFER, pixelBuffers[i], GPU_MEMORY_STREAMING, "frame dumper readback", (size_t)width * height * 4);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        row.resize(width * 3);
+    }
+
+    ~FrameDumper()
+    {
+        for (unsigned int i = 0; i < 2; i++)
+            gpuMemory().release(GpuMemory::BUFFER, pixelBuffers[i]);
+        glDeleteBuffers(2, pixelBuffers);
+    }
+
+    // queues the read back of the current frame as frame number index, then writes the previous one
+    void capture(unsigned int index)
+    {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[next]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glReadPixels(0, 0, width, height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        flush();
+        pending = true;
+        pendingIndex = index;
+        next ^= 1;
+    }
+
+    // writes the last captured frame, if it has not been written yet
+    void flush()
+    {
+        if (!pending)
+            return;
+        pending = false;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[next ^ 1]);
+        const unsigned char* pixels = static_cast<const unsigned char*>(
+            glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, (GLsizeiptr)width * height * 4, GL_MAP_READ_BIT));
+        if (pixels)
+            write(pixels);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+
+private:
+    std::string prefix;
+    unsigned int width, height;
+    unsigned int pixelBuffers[2];
+    bool pending;              // pixelBuffers[next ^ 1] holds a frame that is not written yet
+    unsigned int pendingIndex;
+    unsigned int next;         // buffer of the next capture
+    std::vector<unsigned char> row;
+
+    // GL rows start at the bottom, PPM rows at the top
+    void write(const unsigned char* pixels)
+    {
+        char number[16];
+        std::snprintf(number, sizeof(number), "%04u.ppm", pendingIndex);
+        std::string path = prefix + number;
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file)
+        {
+            std::cout << "ERROR::FRAME_DUMP::FILE_NOT_SUCCESFULLY_WRITTEN: " << path << std::endl;
+            return;
+        }
+        std::fprintf(file, "P6\n%u %u\n255\n", width, height);
+        for (unsigned int y = height; y-- > 0;)
+        {
+            const unsigned char* source = pixels + (size_t)y * width * 4;
+            for (unsigned int x = 0; x < width; x++)
+            {
+                row[x * 3 + 0] = source[x * 4 + 0];
+                row[x * 3 + 1] = source[x * 4 + 1];
+                row[x * 3 + 2] = source[x * 4 + 2];
+            }
+            std::fwrite(&row[0], 1, row.size(), file);
+        }
+        std::fclose(file);
+    }
+};
+#endif
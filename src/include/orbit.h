@@ -0,0 +1,90 @@
+#ifndef ORBIT_H
+#define ORBIT_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <cmath>
+
+// speed up time so that 1 real second = 10 simulation days
+const float TIME_SCALE = 10.0f;
+
+// Describes one body of the solar system. Every body moves on a circular orbit in the xz-plane
+// around the sun and spins around its own y-axis. Periods are expressed in simulation days.
+struct Body {
+    const char* name;
+    const char* texture;
+    float orbitRadius;
+    float orbitPeriod;
+    float rotationPeriod;
+    float scale;
+
+    // position of the body's center at the given simulation time
+    glm::vec3 position(float simulationTime) const
+    {
+        float orbitAngle = simulationTime / orbitPeriod;
+        return glm::vec3(orbitRadius * cos(orbitAngle), 0.0f, orbitRadius * sin(orbitAngle));
+    }
+
+    // velocity of the body's center (world units per simulation day) at the given simulation time
+    glm::vec3 velocity(float simulationTime) const
+    {
+        float orbitAngle = simulationTime / orbitPeriod;
+        float speed = orbitRadius / orbitPeriod;
+        return glm::vec3(-speed * sin(orbitAngle), 0.0f, speed * cos(orbitAngle));
+    }
+
+    // evaluates position() for a whole batch of times, written as separate x/y/z arrays.
+    // Iterations are independent so the compiler can vectorize the loop.
+    void positions(const float* times, unsigned int count, float* x, float* y, float* z) const
+    {
+        for (unsigned int i = 0; i < count; i++)
+        {
+            float orbitAngle = times[i] / orbitPeriod;
+            x[i] = orbitRadius * cosf(orbitAngle);
+            y[i] = 0.0f;
+            z[i] = orbitRadius * sinf(orbitAngle);
+        }
+    }
+
+    // model matrix: move the body along its orbit, spin it around its own y-axis and scale it
+    glm::mat4 modelMatrix(float simulationTime) const
+    {
+        glm::mat4 model = glm::mat4(1.0f);
+        model = glm::translate(model, position(simulationTime));
+        model = glm::rotate(model, simulationTime / rotationPeriod, glm::vec3(0.0f, 1.0f, 0.0f));
+        model = glm::scale(model, glm::vec3(scale, scale, scale));
+        return model;
+    }
+};
+
+// The sun sits at the origin and rotates approximately once every 27 Earth days near its equator.
+// Planet sizes are relative to the sun; the small planets are drawn twice as big as their real ratio.
+const Body BODIES[] = {
+    //  name       texture                                                   radius  orbit    rotation  scale
+    { "sun",     "../../src/resources/textures/planets/2k_sun.jpg",      0.0f,   1.0f,    27.0f,    2.0f   },
+    { "mercury", "../../src/resources/textures/planets/2k_mercury.jpg",  5.0f,   88.0f,   86.6f,    0.2f   },
+    { "venus",   "../../src/resources/textures/planets/2k_venus.jpg",    10.0f,  225.0f,  90.0f,    0.19f  },
+    { "earth",   "../../src/resources/textures/planets/earth2k.jpg",     15.0f,  200.0f,  10.0f,    0.2f   },
+    { "mars",    "../../src/resources/textures/planets/2k_mars.jpg",     20.0f,  10.88f,  10.5f,    0.106f },
+    { "jupiter", "../../src/resources/textures/planets/2k_jupiter.jpg",  25.0f,  11.86f,  0.41f,    1.0f   },
+    { "saturn",  "../../src/resources/textures/planets/2k_saturn.jpg",   30.0f,  29.46f,  0.45f,    0.83f  },
+    { "uranus",  "../../src/resources/textures/planets/2k_uranus.jpg",   35.0f,  84.0f,   0.72f,    0.72f  },
+    { "neptune", "../../src/resources/textures/planets/2k_neptune.jpg",  40.0f,  165.0f,  0.67f,    0.7f   },
+};
+const unsigned int BODY_COUNT = sizeof(BODIES) / sizeof(BODIES[0]);
+
+// indices into BODIES
+enum BodyIndex {
+    SUN,
+    MERCURY,
+    VENUS,
+    EARTH,
+    MARS,
+    JUPITER,
+    SATURN,
+    URANUS,
+    NEPTUNE
+};
+
+#endif
@@ -0,0 +1,148 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "gl_state.h"
+#include "frame_profiler.h"
+
+// passes in execution order
+enum RenderPass {
+    PASS_OPAQUE = 0,
+    PASS_SKY = 1 // after the opaque geometry so that the depth test rejects hidden sky
+};
+
+// One recorded draw. execute(object, context) issues the GL calls; the queue binds the program first.
+// object and context are owned by the caller and must stay alive until the queue is executed.
+struct RenderCommand {
+    uint64_t key;
+    unsigned int program;
+    void (*execute)(void* object, void* context);
+    void* object;
+    void* context;
+    int phase; // FrameProfiler phase the command is timed as, -1 for none
+};
+
+// Draw submission in two phases: during the frame submit() records commands with a 64 bit sort key,
+// execute() radix-sorts them by key and then runs them in that order.
+//
+// Keys are  pass (4 bits) | program (12) | material (16) | depth (32),  so state changes are grouped by
+// program, then by material, and each group draws front to back. depthBits() maps the distance from the
+// camera to a command's nearest geometry to the depth field.
+class RenderQueue
+{
+public:
+    // statistics of the last execute()
+    unsigned int lastCommandCount;
+    unsigned int lastProgramChanges;
+
+    RenderQueue() : lastCommandCount(0), lastProgramChanges(0), profiler(NULL) {}
+
+    // commands submitted with a phase are timed by the profiler, NULL turns timing off
+    void setProfiler(FrameProfiler* profiler)
+    {
+        this->profiler = profiler;
+    }
+
+    static uint64_t makeKey(RenderPass pass, unsigned int program, unsigned int material, uint32_t depth)
+    {
+        return (uint64_t)(pass & 0xf) << 60 | (uint64_t)(program & 0xfff) << 48 | (uint64_t)(material & 0xffff) << 32 | depth;
+    }
+
+    // distance from the camera mapped to the 32 bit depth field, 0 at the camera and saturated at farPlane
+    static uint32_t depthBits(float distance, float farPlane)
+    {
+        float normalized = distance / farPlane;
+        if (!(normalized > 0.0f))
+            return 0;
+        if (normalized >= 1.0f)
+            return 0xffffffffu;
+        return (uint32_t)(normalized * 4294967295.0f);
+    }
+
+    void submit(RenderPass pass, unsigned int program, unsigned int material, uint32_t depth,
+                void (*execute)(void*, void*), void* object, void* context = NULL, int phase = -1)
+    {
+        RenderCommand command;
+        command.key = makeKey(pass, program, material, depth);
+        command.program = program;
+        command.execute = execute;
+        command.object = object;
+        command.context = context;
+        command.phase = phase;
+        commands.push_back(command);
+    }
+
+    // sorts, runs and clears the recorded commands
+    void execute()
+    {
+        sort();
+        unsigned int programChanges = 0, program = 0;
+        for (unsigned int i = 0; i < commands.size(); i++)
+        {
+            const RenderCommand& command = commands[i];
+            if (i == 0 || command.program != program)
+                programChanges++;
+            program = command.program;
+            ProfileScope scope(command.phase >= 0 ? profiler : NULL, command.phase);
+            glState().useProgram(command.program);
+            command.execute(command.object, command.context);
+        }
+        lastCommandCount = commands.size();
+        lastProgramChanges = programChanges;
+        commands.clear();
+    }
+
+    unsigned int size() const
+    {
+        return commands.size();
+    }
+
+private:
+    std::vector<RenderCommand> commands;
+    std::vector<RenderCommand> scratch;
+    FrameProfiler* profiler;
+
+    // LSD radix sort on the key, 8 bits per pass. Passes whose digit is the same for every command (the
+    // pass bits, usually) are skipped, and a small queue falls back to insertion sort.
+    void sort()
+    {
+        size_t n = commands.size();
+        if (n < 32)
+        {
+            for (size_t i = 1; i < n; i++)
+            {
+                RenderCommand command = commands[i];
+                size_t j = i;
+                for (; j > 0 && commands[j - 1].key > command.key; j--)
+                    commands[j] = commands[j - 1];
+                commands[j] = command;
+            }
+            return;
+        }
+        scratch.resize(n);
+        for (unsigned int shift = 0; shift < 64; shift += 8)
+        {
+            size_t offsets[256] = { 0 };
+            for (size_t i = 0; i < n; i++)
+                offsets[(commands[i].key >> shift) & 0xff]++;
+            if (offsets[(commands[0].key >> shift) & 0xff] == n)
+                continue;
+            size_t sum = 0;
+            for (unsigned int d = 0; d < 256; d++)
+            {
+                size_t count = offsets[d];
+                offsets[d] = sum;
+                sum += count;
+            }
+            for (size_t i = 0; i < n; i++)
+                scratch[offsets[(commands[i].key >> shift) & 0xff]++] = commands[i];
+            commands.swap(scratch);
+        }
+    }
+};
+#endif
@@ -0,0 +1,220 @@
+#ifndef SHADER_REFLECTION_H
+#define SHADER_REFLECTION_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Introspection of a linked program: every active uniform (including samplers) and uniform block, read
+// once after linking and kept in a flat open-addressing hash table keyed by name. Looking a name up
+// hashes the C string in place, so it neither allocates nor talks to the driver.
+class UniformTable
+{
+public:
+    struct Entry {
+        uint32_t hash;   // 0 marks an empty slot
+        unsigned int name; // offset into the name pool
+        GLint location;  // -1 for uniform blocks
+        GLenum type;     // GL type of the uniform, 0 for uniform blocks
+        GLint size;      // array size, or data size in bytes of a uniform block
+        GLint binding;   // texture unit of a sampler or binding point of a block, -1 otherwise
+        bool block;
+    };
+
+    UniformTable() : count(0) {}
+
+    void reflect(GLuint program)
+    {
+        slots.clear();
+        names.clear();
+        count = 0;
+
+        GLint uniformCount = 0, blockCount = 0;
+        glGetProgramInterfaceiv(program, GL_UNIFORM, GL_ACTIVE_RESOURCES, &uniformCount);
+        glGetProgramInterfaceiv(program, GL_UNIFORM_BLOCK, GL_ACTIVE_RESOURCES, &blockCount);
+        slots.assign(tableSize(uniformCount + blockCount), Entry());
+
+        char name[256];
+        for (GLint i = 0; i < uniformCount; i++)
+        {
+            const GLenum properties[] = { GL_LOCATION, GL_TYPE, GL_ARRAY_SIZE, GL_BLOCK_INDEX };
+            GLint values[4];
+            glGetProgramResourceiv(program, GL_UNIFORM, i, 4, properties, 4, NULL, values);
+            // members of uniform blocks have no location, they are reached through their block
+            if (values[3] != -1)
+                continue;
+            glGetProgramResourceName(program, GL_UNIFORM, i, sizeof(name), NULL, name);
+            GLint binding = -1;
+            if (isSampler(values[1]))
+                glGetUniformiv(program, values[0], &binding);
+            insert(name, values[0], values[1], values[2], binding, false);
+            // arrays are reported as "name[0]", make them reachable as "name" too
+            char* bracket = strstr(name, "[0]");
+            if (bracket && bracket[3] == '\0')
+            {
+                *bracket = '\0';
+                insert(name, values[0], values[1], values[2], binding, false);
+            }
+        }
+        for (GLint i = 0; i < blockCount; i++)
+        {
+            const GLenum properties[] = { GL_BUFFER_BINDING, GL_BUFFER_DATA_SIZE };
+            GLint values[2];
+            glGetProgramResourceiv(program, GL_UNIFORM_BLOCK, i, 2, properties, 2, NULL, values);
+            glGetProgramResourceName(program, GL_UNIFORM_BLOCK, i, sizeof(name), NULL, name);
+            insert(name, -1, 0, values[1], values[0], true);
+        }
+    }
+
+    const Entry* find(const char* name) const
+    {
+        if (slots.empty())
+            return NULL;
+        uint32_t hash = hashName(name);
+        size_t mask = slots.size() - 1;
+        for (size_t slot = hash & mask; slots[slot].hash != 0; slot = (slot + 1) & mask)
+        {
+            if (slots[slot].hash == hash && strcmp(&names[slots[slot].name], name) == 0)
+                return &slots[slot];
+        }
+        return NULL;
+    }
+
+    // location of a uniform, -1 (ignored by glUniform*) if the program has no such active uniform
+    GLint location(const char* name) const
+    {
+        const Entry* entry = find(name);
+        return entry ? entry->location : -1;
+    }
+
+    unsigned int size() const
+    {
+        return count;
+    }
+
+    static bool isSampler(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_SAMPLER_2D: case GL_SAMPLER_3D: case GL_SAMPLER_CUBE: case GL_SAMPLER_2D_ARRAY:
+        case GL_SAMPLER_2D_SHADOW: case GL_SAMPLER_CUBE_SHADOW: case GL_SAMPLER_2D_ARRAY_SHADOW:
+        case GL_SAMPLER_BUFFER: case GL_SAMPLER_2D_MULTISAMPLE:
+        case GL_INT_SAMPLER_2D: case GL_INT_SAMPLER_2D_ARRAY: case GL_UNSIGNED_INT_SAMPLER_2D: case GL_UNSIGNED_INT_SAMPLER_2D_ARRAY:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+private:
+    std::vector<Entry> slots;
+    std::vector<char> names;
+    unsigned int count;
+
+    // FNV-1a, never 0 so that 0 can mark empty slots
+    static uint32_t hashName(const char* name)
+    {
+        uint32_t hash = 2166136261u;
+        for (; *name; name++)
+            hash = (hash ^ (unsigned char)*name) * 16777619u;
+        return hash ? hash : 1;
+    }
+
+    // at most half full, counting the extra entries for array names
+    static size_t tableSize(GLint resources)
+    {
+        size_t size = 16;
+        while (size < 4 * (size_t)resources)
+            size <<= 1;
+        return size;
+    }
+
+    void insert(const char* name, GLint location, GLenum type, GLint size, GLint binding, bool block)
+    {
+        if (find(name))
+            return;
+        Entry entry;
+        entry.hash = hashName(name);
+        entry.name = names.size();
+        entry.location = location;
+        entry.type = type;
+        entry.size = size;
+        entry.binding = binding;
+        entry.block = block;
+        names.insert(names.end(), name, name + strlen(name) + 1);
+        size_t mask = slots.size() - 1;
+        size_t slot = entry.hash & mask;
+        while (slots[slot].hash != 0)
+            slot = (slot + 1) & mask;
+        slots[slot] = entry;
+        count++;
+    }
+};
+
+// GL type a uniform must have to be set from a T
+template<typename T> struct UniformType;
+template<> struct UniformType<int>          { static bool matches(GLenum type) { return type == GL_INT || type == GL_BOOL || UniformTable::isSampler(type); } };
+template<> struct UniformType<unsigned int> { static bool matches(GLenum type) { return type == GL_UNSIGNED_INT; } };
+template<> struct UniformType<float>        { static bool matches(GLenum type) { return type == GL_FLOAT; } };
+template<> struct UniformType<glm::vec2>    { static bool matches(GLenum type) { return type == GL_FLOAT_VEC2; } };
+template<> struct UniformType<glm::vec3>    { static bool matches(GLenum type) { return type == GL_FLOAT_VEC3; } };
+template<> struct UniformType<glm::vec4>    { static bool matches(GLenum type) { return type == GL_FLOAT_VEC4; } };
+template<> struct UniformType<glm::mat2>    { static bool matches(GLenum type) { return type == GL_FLOAT_MAT2; } };
+template<> struct UniformType<glm::mat3>    { static bool matches(GLenum type) { return type == GL_FLOAT_MAT3; } };
+template<> struct UniformType<glm::mat4>    { static bool matches(GLenum type) { return type == GL_FLOAT_MAT4; } };
+
+inline void programUniform(GLuint program, GLint location, int value)                { glProgramUniform1i(program, location, value); }
+inline void programUniform(GLuint program, GLint location, unsigned int value)       { glProgramUniform1ui(program, location, value); }
+inline void programUniform(GLuint program, GLint location, float value)              { glProgramUniform1f(program, location, value); }
+inline void programUniform(GLuint program, GLint location, const glm::vec2& value)   { glProgramUniform2fv(program, location, 1, &value[0]); }
+inline void programUniform(GLuint program, GLint location, const glm::vec3& value)   { glProgramUniform3fv(program, location, 1, &value[0]); }
+inline void programUniform(GLuint program, GLint location, const glm::vec4& value)   { glProgramUniform4fv(program, location, 1, &value[0]); }
+inline void programUniform(GLuint program, GLint location, const glm::mat2& value)   { glProgramUniformMatrix2fv(program, location, 1, GL_FALSE, &value[0][0]); }
+inline void programUniform(GLuint program, GLint location, const glm::mat3& value)   { glProgramUniformMatrix3fv(program, location, 1, GL_FALSE, &value[0][0]); }
+inline void programUniform(GLuint program, GLint location, const glm::mat4& value)   { glProgramUniformMatrix4fv(program, location, 1, GL_FALSE, &value[0][0]); }
+
+// A uniform resolved once; set() is a single glProgramUniform* call and works whether or not the
+// program is currently in use. A default constructed handle (or one for an inactive uniform) has
+// location -1, which GL silently ignores.
+template<typename T>
+class Uniform
+{
+public:
+    Uniform() : program(0), location(-1) {}
+    Uniform(GLuint program, GLint location) : program(program), location(location) {}
+
+    void set(const T& value) const
+    {
+        programUniform(program, location, value);
+    }
+
+    bool valid() const
+    {
+        return location != -1;
+    }
+
+private:
+    GLuint program;
+    GLint location;
+};
+
+// typed handle lookup shared by the shader classes
+template<typename T>
+Uniform<T> resolveUniform(GLuint program, const UniformTable& uniforms, const char* name)
+{
+    const UniformTable::Entry* entry = uniforms.find(name);
+    if (!entry || entry->block)
+        return Uniform<T>();
+    if (!UniformType<T>::matches(entry->type))
+    {
+        std::cout << "ERROR::SHADER::UNIFORM_TYPE_MISMATCH: " << name << std::endl;
+        return Uniform<T>();
+    }
+    return Uniform<T>(program, entry->location);
+}
+#endif
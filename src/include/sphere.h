@@ -0,0 +1,110 @@
+#ifndef SPHERE_H
+#define SPHERE_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "gl_state.h"
+#include "gpu_memory.h"
+#include "mesh.h"
+#include "trace.h"
+
+//build a unit sphere with the given number of segments around and top to bottom as one triangle strip
+inline void buildSphere(unsigned int segments, std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+    TraceScope trace("buildSphere");
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec2> uv;
+
+    const unsigned int X_SEGMENTS = segments;
+    const unsigned int Y_SEGMENTS = segments;
+    const float PI = 3.14159265359;
+    for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
+    {
+        for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
+        {
+            float xSegment = (float)x / (float)X_SEGMENTS;
+            float ySegment = (float)y / (float)Y_SEGMENTS;
+            float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+            float yPos = std::cos(ySegment * PI);
+            float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
+
+            positions.push_back(glm::vec3(xPos, yPos, zPos));
+            uv.push_back(glm::vec2(xSegment, ySegment));
+        }
+    }
+
+    bool oddRow = false;
+    for (int y = 0; y < Y_SEGMENTS; ++y)
+    {
+        if (!oddRow) //even rows: y == 0, y == 2; and so on
+        {
+            for (int x = 0; x <= X_SEGMENTS; ++x)
+            {
+                indices.push_back(y * (X_SEGMENTS + 1) + x);
+                indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+            }
+        }
+        else
+        {
+            for (int x = X_SEGMENTS; x >= 0; --x)
+            {
+                indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+                indices.push_back(y * (X_SEGMENTS + 1) + x);
+            }
+        }
+        oddRow = !oddRow;
+    }
+
+    for (int i = 0; i < positions.size(); ++i)
+    {
+        Vertex vertex;
+        vertex.Position = positions[i];
+        vertex.Normal = positions[i]; // unit sphere
+        vertex.TexCoords = uv[i];
+        vertex.Tangent = glm::vec3(0.0f);
+        vertex.Bitangent = glm::vec3(0.0f);
+        vertices.push_back(vertex);
+    }
+}
+
+//create a shphere with the given number of segments around and top to bottom, returns its index count
+inline unsigned int createSphere(unsigned int& VAO, unsigned int& VBO, unsigned int& EBO, unsigned int segments = 64) {
+    TraceScope trace("createSphere");
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &VBO);
+    glGenBuffers(1, &EBO);
+
+    std::vector<Vertex> vertices;
+    std::vector<unsigned int> indices;
+    buildSphere(segments, vertices, indices);
+
+    std::vector<float> data;
+    for (int i = 0; i < vertices.size(); ++i)
+    {
+        data.push_back(vertices[i].Position.x);
+        data.push_back(vertices[i].Position.y);
+        data.push_back(vertices[i].Position.z);
+        data.push_back(vertices[i].TexCoords.x);
+        data.push_back(vertices[i].TexCoords.y);
+    }
+
+    glState().bindVertexArray(VAO);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO);
+    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO); 
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    gpuMemory().allocate(GpuMemory::BUFFER, VBO, GPU_MEMORY_MESHES, "sphere mesh", data.size() * sizeof(float));
+    gpuMemory().allocate(GpuMemory::BUFFER, EBO, GPU_MEMORY_MESHES, "sphere mesh", indices.size() * sizeof(unsigned int));
+    gpuMemory().uploaded(data.size() * sizeof(float) + indices.size() * sizeof(unsigned int));
+
+    float stride = (3 + 2) * sizeof(float);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+
+    return indices.size();
+}
+#endif
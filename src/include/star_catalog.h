@@ -0,0 +1,115 @@
+#ifndef STAR_CATALOG_H
+#define STAR_CATALOG_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// A star as stored in the catalog file and uploaded to the GPU unchanged (20 bytes).
+struct Star {
+    float direction[3];  // unit vector from the observer
+    float magnitude;     // apparent visual magnitude, smaller is brighter
+    unsigned char color[4]; // sRGB of the star's black body color, alpha unused
+};
+
+// Binary star catalog:
+//   header: "STC1", u32 starCount
+//   then starCount Star records as above, little-endian floats
+const uint32_t STAR_CATALOG_MAGIC = 0x31435453; // "STC1"
+
+// black body color of a star of B-V color index bv: temperature after Ballesteros (2012), then
+// Tanner Helland's fit of the black body spectrum to RGB
+inline void starColor(float bv, unsigned char color[4])
+{
+    float temperature = 4600.0f * (1.0f / (0.92f * bv + 1.7f) + 1.0f / (0.92f * bv + 0.62f));
+    float t = temperature / 100.0f;
+    float r, g, b;
+    if (t <= 66.0f)
+    {
+        r = 255.0f;
+        g = 99.4708025861f * std::log(t) - 161.1195681661f;
+        b = t <= 19.0f ? 0.0f : 138.5177312231f * std::log(t - 10.0f) - 305.0447927307f;
+    }
+    else
+    {
+        r = 329.698727446f * std::pow(t - 60.0f, -0.1332047592f);
+        g = 288.1221695283f * std::pow(t - 60.0f, -0.0755148492f);
+        b = 255.0f;
+    }
+    color[0] = (unsigned char)std::min(std::max(r, 0.0f), 255.0f);
+    color[1] = (unsigned char)std::min(std::max(g, 0.0f), 255.0f);
+    color[2] = (unsigned char)std::min(std::max(b, 0.0f), 255.0f);
+    color[3] = 255;
+}
+
+// Procedural sky: count stars with the number of stars brighter than m growing like 10^(0.6 m) up to
+// faintestMagnitude, half of them concentrated towards a tilted galactic plane, colors drawn around the
+// sun's B-V index.
+inline std::vector<Star> generateStarCatalog(unsigned int count, float faintestMagnitude = 9.5f, unsigned int seed = 7)
+{
+    const float BRIGHTEST_MAGNITUDE = -1.5f;
+    const float GALACTIC_TILT = 1.05f; // radians between the galactic plane and the orbital plane
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+    std::normal_distribution<float> latitudeSpread(0.0f, 0.2f);
+    std::normal_distribution<float> colorIndex(0.65f, 0.45f);
+
+    float lo = std::pow(10.0f, 0.6f * BRIGHTEST_MAGNITUDE);
+    float hi = std::pow(10.0f, 0.6f * faintestMagnitude);
+    float cosTilt = std::cos(GALACTIC_TILT), sinTilt = std::sin(GALACTIC_TILT);
+
+    std::vector<Star> stars(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        Star& star = stars[i];
+        float longitude = 2.0f * 3.14159265359f * unit(random);
+        float z = (i & 1) ? 2.0f * unit(random) - 1.0f : std::sin(latitudeSpread(random));
+        float ring = std::sqrt(std::max(0.0f, 1.0f - z * z));
+        float x = ring * std::cos(longitude), y = ring * std::sin(longitude);
+        // galactic z axis tilted about x
+        star.direction[0] = x;
+        star.direction[1] = y * cosTilt - z * sinTilt;
+        star.direction[2] = y * sinTilt + z * cosTilt;
+        star.magnitude = std::log10(lo + unit(random) * (hi - lo)) / 0.6f;
+        starColor(std::min(std::max(colorIndex(random), -0.3f), 2.0f), star.color);
+    }
+    return stars;
+}
+
+inline bool saveStarCatalog(const std::string& path, const std::vector<Star>& stars)
+{
+    std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+    uint32_t header[2] = { STAR_CATALOG_MAGIC, (uint32_t)stars.size() };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    if (!stars.empty())
+        file.write(reinterpret_cast<const char*>(&stars[0]), stars.size() * sizeof(Star));
+    if (!file)
+    {
+        std::cout << "ERROR::STAR_CATALOG::FILE_NOT_SUCCESFULLY_WRITTEN: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+inline bool loadStarCatalog(const std::string& path, std::vector<Star>& stars)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    uint32_t header[2];
+    if (!file.read(reinterpret_cast<char*>(header), sizeof(header)) || header[0] != STAR_CATALOG_MAGIC)
+        return false;
+    stars.resize(header[1]);
+    if (header[1] > 0 && !file.read(reinterpret_cast<char*>(&stars[0]), stars.size() * sizeof(Star)))
+    {
+        std::cout << "ERROR::STAR_CATALOG::FILE_TRUNCATED: " << path << std::endl;
+        stars.clear();
+        return false;
+    }
+    return true;
+}
+#endif
@@ -0,0 +1,65 @@
+#ifndef STAR_FIELD_H
+#define STAR_FIELD_H
+
+#include <glad/glad.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "star_catalog.h"
+#include "gl_state.h"
+#include "gpu_memory.h"
+
+// Background sky drawn from a star catalog: one vertex per star, one GL_POINTS draw, point size and
+// brightness from the magnitude (shader/stars.vert). The stars are only the size of their records on
+// the GPU, 20 bytes each, instead of six decoded cubemap faces.
+class StarField
+{
+public:
+    unsigned int count;
+
+    StarField(const std::vector<Star>& stars) : count(stars.size())
+    {
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glState().bindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, stars.size() * sizeof(Star), stars.empty() ? NULL : &stars[0], GL_STATIC_DRAW);
+        gpuMemory().allocate(GpuMemory::BUFFER, VBO, GPU_MEMORY_MESHES, "star catalog", stars.size() * sizeof(Star));
+        gpuMemory().uploaded(stars.size() * sizeof(Star));
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Star), (void*)offsetof(Star, direction));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, sizeof(Star), (void*)offsetof(Star, magnitude));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Star), (void*)offsetof(Star, color));
+        glState().bindVertexArray(0);
+    }
+
+    ~StarField()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        gpuMemory().release(GpuMemory::BUFFER, VBO);
+        glDeleteBuffers(1, &VBO);
+    }
+
+    // expects the stars program in use; stars add up where they overlap and lie at infinite depth
+    void draw()
+    {
+        glEnable(GL_PROGRAM_POINT_SIZE);
+        glEnable(GL_BLEND);
+        glBlendFunc(GL_ONE, GL_ONE);
+        glDepthFunc(GL_LEQUAL);
+        glDepthMask(GL_FALSE);
+        glState().bindVertexArray(VAO);
+        glDrawArrays(GL_POINTS, 0, count);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        glDisable(GL_BLEND);
+        glDisable(GL_PROGRAM_POINT_SIZE);
+    }
+
+private:
+    unsigned int VAO, VBO;
+};
+#endif
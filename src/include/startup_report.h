@@ -0,0 +1,123 @@
+#ifndef STARTUP_REPORT_H
+#define STARTUP_REPORT_H
+
+#ifndef _WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Time to first frame of --startup-report, split into the consecutive phases of startup. mark() closes the
+// phase that ran since the previous mark (or since construction).
+//
+// A cold start is simulated by evicting the assets from the page cache first, so texture and shader files
+// come from disk again; a warm start reads them from memory. The executable, the shared libraries and the
+// driver's own shader cache are left alone.
+class StartupReport
+{
+public:
+    struct Phase {
+        std::string name;
+        double milliseconds;
+    };
+
+    std::string mode;  // "cold" or "warm"
+    double budgetMs;   // 0 for none
+    std::vector<Phase> phases;
+
+    StartupReport(const std::string& mode, double budgetMs) : mode(mode), budgetMs(budgetMs)
+    {
+        start = last = std::chrono::steady_clock::now();
+    }
+
+    void mark(const char* name)
+    {
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        Phase phase = { name, std::chrono::duration<double, std::milli>(now - last).count() };
+        phases.push_back(phase);
+        last = now;
+    }
+
+    double totalMs() const
+    {
+        return std::chrono::duration<double, std::milli>(last - start).count();
+    }
+
+    bool withinBudget() const
+    {
+        return budgetMs <= 0.0 || totalMs() <= budgetMs;
+    }
+
+    // phase table, then one machine-readable line
+    void print(const char* renderer) const
+    {
+        double total = totalMs();
+        std::printf("startup (%s, %s): %.1f ms to first frame\n", mode.c_str(), renderer, total);
+        for (unsigned int i = 0; i < phases.size(); i++)
+            std::printf("  %-16s %9.1f ms %5.1f%%\n", phases[i].name.c_str(), phases[i].milliseconds,
+                        total > 0.0 ? 100.0 * phases[i].milliseconds / total : 0.0);
+        if (budgetMs > 0.0)
+            std::printf("  budget %.1f ms: %s\n", budgetMs, withinBudget() ? "ok" : "EXCEEDED");
+
+        std::printf("startup mode=%s total_ms=%.2f", mode.c_str(), total);
+        for (unsigned int i = 0; i < phases.size(); i++)
+        {
+            std::string key = phases[i].name;
+            for (unsigned int c = 0; c < key.size(); c++)
+                if (key[c] == ' ')
+                    key[c] = '_';
+            std::printf(" %s_ms=%.2f", key.c_str(), phases[i].milliseconds);
+        }
+        if (budgetMs > 0.0)
+            std::printf(" budget_ms=%.2f within_budget=%d", budgetMs, withinBudget() ? 1 : 0);
+        std::printf("\n");
+    }
+
+    // drops the cached pages of every file below directory, returns the number of files; clean pages of
+    // files we can open are dropped without special privileges
+    static unsigned int evictFromPageCache(const std::string& directory)
+    {
+        unsigned int files = 0;
+#if !defined(_WIN32) && defined(POSIX_FADV_DONTNEED)
+        DIR* dir = opendir(directory.c_str());
+        if (!dir)
+        {
+            std::printf("ERROR::STARTUP::DIRECTORY_NOT_FOUND: %s\n", directory.c_str());
+            return 0;
+        }
+        while (dirent* entry = readdir(dir))
+        {
+            std::string name = entry->d_name;
+            if (name == "." || name == "..")
+                continue;
+            std::string path = directory + "/" + name;
+            struct stat info;
+            if (stat(path.c_str(), &info) != 0)
+                continue;
+            if (S_ISDIR(info.st_mode))
+                files += evictFromPageCache(path);
+            else if (S_ISREG(info.st_mode))
+            {
+                int fd = open(path.c_str(), O_RDONLY);
+                if (fd < 0)
+                    continue;
+                if (posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0)
+                    files++;
+                close(fd);
+            }
+        }
+        closedir(dir);
+#endif
+        return files;
+    }
+
+private:
+    std::chrono::steady_clock::time_point start, last;
+};
+#endif
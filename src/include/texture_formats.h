@@ -0,0 +1,17 @@
+#ifndef TEXTURE_FORMATS_H
+#define TEXTURE_FORMATS_H
+
+#include <glad/glad.h>
+
+// Block-compressed internal formats of baked textures. S3TC comes from EXT_texture_compression_s3tc, which
+// the GL loader may not define; BPTC is core since 4.2.
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#endif
@@ -0,0 +1,307 @@
+#ifndef TEXTURE_LOADER_H
+#define TEXTURE_LOADER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "gl_state.h"
+#include "gpu_memory.h"
+#include "ktx2.h"
+#include "texture_formats.h"
+#include "trace.h"
+
+// utility function for loading a 2D texture from file
+// ---------------------------------------------------
+inline unsigned int loadTexture(char const* path)
+{
+    TraceScope trace("loadTexture", Trace::intern(path));
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    int width, height, nrComponents;
+    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
+    if (data)
+    {
+        GLenum format;
+        if (nrComponents == 1)
+            format = GL_RED;
+        else if (nrComponents == 3)
+            format = GL_RGB;
+        else if (nrComponents == 4)
+            format = GL_RGBA;
+
+        glState().bindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        gpuMemory().allocate(GpuMemory::TEXTURE, textureID, GPU_MEMORY_TEXTURES, path,
+                             GpuMemory::textureBytes(format, width, height, 1, GpuMemory::mipLevels(width, height)));
+        gpuMemory().uploaded((size_t)width * height * nrComponents);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        stbi_image_free(data);
+    }
+    else
+    {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+        stbi_image_free(data);
+    }
+
+    return textureID;
+}
+
+// GL internal format of a KTX2 block format; BC1 and BC3 come from EXT_texture_compression_s3tc, which every
+// desktop driver has, BC7 (BPTC) is core since 4.2
+// ------------------------------------------------------------------------------------------------------
+inline GLenum compressedInternalFormat(uint32_t vkFormat)
+{
+    switch (vkFormat)
+    {
+    case KTX2_VK_FORMAT_BC1_RGB_UNORM:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case KTX2_VK_FORMAT_BC3_UNORM:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case KTX2_VK_FORMAT_BC7_UNORM:
+        return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    }
+    return GL_NONE;
+}
+
+// loads a texture baked by TextureBaker: the stored mip chain is uploaded as it is, nothing is decoded
+// ----------------------------------------------------------------------------------------------------
+inline unsigned int loadCompressedTexture(char const* path)
+{
+    TraceScope trace("loadCompressedTexture", Trace::intern(path));
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+
+    Ktx2Image image;
+    if (!readKtx2(path, image))
+    {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+        return textureID;
+    }
+    GLenum format = compressedInternalFormat(image.vkFormat);
+    glState().bindTexture(GL_TEXTURE_2D, textureID);
+    glTexStorage2D(GL_TEXTURE_2D, image.levels.size(), format, image.width, image.height);
+    for (unsigned int i = 0; i < image.levels.size(); i++)
+    {
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, std::max(image.width >> i, 1u), std::max(image.height >> i, 1u),
+                                  format, image.levels[i].size(), &image.levels[i][0]);
+        gpuMemory().uploaded(image.levels[i].size());
+    }
+    gpuMemory().allocate(GpuMemory::TEXTURE, textureID, GPU_MEMORY_TEXTURES, path,
+                         GpuMemory::textureBytes(format, image.width, image.height, 1, image.levels.size()));
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    return textureID;
+}
+
+// resizes an 8 bit image: box filter over the covered source pixels when shrinking an axis, bilinear
+// interpolation when enlarging it
+// ----------------------------------------------------------------------------------------------------
+inline void resampleImage(const unsigned char* source, int sourceWidth, int sourceHeight, unsigned char* destination, int width, int height, int channels)
+{
+    float scaleX = (float)sourceWidth / width;
+    float scaleY = (float)sourceHeight / height;
+    for (int y = 0; y < height; y++)
+    {
+        // source rows [y0, y1] and their weights
+        int y0, y1;
+        float fy = 0.0f;
+        if (scaleY > 1.0f)
+        {
+            y0 = (int)(y * scaleY);
+            y1 = std::min(std::max((int)((y + 1) * scaleY) - 1, y0), sourceHeight - 1);
+        }
+        else
+        {
+            float sy = std::max((y + 0.5f) * scaleY - 0.5f, 0.0f);
+            y0 = std::min((int)sy, sourceHeight - 1);
+            y1 = std::min(y0 + 1, sourceHeight - 1);
+            fy = sy - y0;
+        }
+        for (int x = 0; x < width; x++)
+        {
+            int x0, x1;
+            float fx = 0.0f;
+            if (scaleX > 1.0f)
+            {
+                x0 = (int)(x * scaleX);
+                x1 = std::min(std::max((int)((x + 1) * scaleX) - 1, x0), sourceWidth - 1);
+            }
+            else
+            {
+                float sx = std::max((x + 0.5f) * scaleX - 0.5f, 0.0f);
+                x0 = std::min((int)sx, sourceWidth - 1);
+                x1 = std::min(x0 + 1, sourceWidth - 1);
+                fx = sx - x0;
+            }
+            for (int c = 0; c < channels; c++)
+            {
+                float value = 0.0f, weightSum = 0.0f;
+                for (int sy = y0; sy <= y1; sy++)
+                {
+                    float wy = scaleY > 1.0f ? 1.0f : (sy == y0 ? 1.0f - fy : fy);
+                    for (int sx = x0; sx <= x1; sx++)
+                    {
+                        float wx = scaleX > 1.0f ? 1.0f : (sx == x0 ? 1.0f - fx : fx);
+                        value += wx * wy * source[(sy * sourceWidth + sx) * channels + c];
+                        weightSum += wx * wy;
+                    }
+                }
+                destination[(y * width + x) * channels + c] = (unsigned char)(value / weightSum + 0.5f);
+            }
+        }
+    }
+}
+
+// layer size of an array texture made of these images: the most common image size (the larger one on a
+// tie), read from the image headers without decoding anything
+// ------------------------------------------------------------------------------------------------------
+inline void textureArrayLayerSize(const std::vector<std::string>& paths, int& width, int& height)
+{
+    std::vector<std::pair<int, int> > sizes;
+    for (unsigned int i = 0; i < paths.size(); i++)
+    {
+        int layerWidth, layerHeight, nrComponents;
+        if (stbi_info(paths[i].c_str(), &layerWidth, &layerHeight, &nrComponents))
+            sizes.push_back(std::make_pair(layerWidth, layerHeight));
+    }
+    width = 1;
+    height = 1;
+    unsigned int bestCount = 0;
+    for (unsigned int i = 0; i < sizes.size(); i++)
+    {
+        unsigned int count = std::count(sizes.begin(), sizes.end(), sizes[i]);
+        if (count > bestCount || (count == bestCount && sizes[i].first * sizes[i].second > width * height))
+        {
+            bestCount = count;
+            width = sizes[i].first;
+            height = sizes[i].second;
+        }
+    }
+}
+
+// the asset a texture array counts to in the GPU memory report: its first layer's file and the layer count
+// -------------------------------------------------------------------------------------------------------
+inline std::string textureArrayName(const std::vector<std::string>& paths)
+{
+    if (paths.empty())
+        return "texture array";
+    return paths[0] + " (array of " + std::to_string(paths.size()) + " layers)";
+}
+
+// loads images into the layers of one 2D array texture, in the order given. Images of another size than
+// the layer size are resampled to it.
+// -------------------------------------------------------------------------------------------------------
+inline unsigned int loadTextureArray(std::vector<std::string> paths)
+{
+    TraceScope trace("loadTextureArray");
+    int width, height;
+    textureArrayLayerSize(paths, width, height);
+    GLint maxLayers;
+    glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+    if ((GLint)paths.size() > maxLayers)
+        std::cout << "Texture array has " << paths.size() << " layers, the driver supports " << maxLayers << std::endl;
+
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glState().bindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, width, height, paths.size(), 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+    // with the mip chain generated below
+    gpuMemory().allocate(GpuMemory::TEXTURE, textureID, GPU_MEMORY_TEXTURES, textureArrayName(paths),
+                         GpuMemory::textureBytes(GL_RGB8, width, height, paths.size(), GpuMemory::mipLevels(width, height)));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // RGB rows of odd widths are not 4 byte aligned
+
+    std::vector<unsigned char> resampled;
+    for (unsigned int i = 0; i < paths.size(); i++)
+    {
+        TraceScope traceLayer("texture layer", Trace::intern(paths[i].c_str()));
+        int layerWidth, layerHeight, nrComponents;
+        unsigned char* data = stbi_load(paths[i].c_str(), &layerWidth, &layerHeight, &nrComponents, 3);
+        if (data && (layerWidth != width || layerHeight != height))
+        {
+            std::cout << "Texture array layer resampled from " << layerWidth << "x" << layerHeight << " to " << width << "x" << height << " at path: " << paths[i] << std::endl;
+            resampled.resize(width * height * 3);
+            resampleImage(data, layerWidth, layerHeight, &resampled[0], width, height, 3);
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, width, height, 1, GL_RGB, GL_UNSIGNED_BYTE, &resampled[0]);
+        }
+        else if (data)
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, i, width, height, 1, GL_RGB, GL_UNSIGNED_BYTE, data);
+        else
+            std::cout << "Texture failed to load at path: " << paths[i] << std::endl;
+        if (data)
+            gpuMemory().uploaded((size_t)width * height * 3);
+        stbi_image_free(data);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+    return textureID;
+}
+
+// loads a cubemap texture from 6 individual texture faces
+// order:
+// +X (right)
+// -X (left)
+// +Y (top)
+// -Y (bottom)
+// +Z (front) 
+// -Z (back)
+// -------------------------------------------------------
+inline unsigned int loadCubemap(std::vector<std::string> faces)
+{
+    TraceScope trace("loadCubemap");
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glState().bindTexture(GL_TEXTURE_CUBE_MAP, textureID);
+
+    int width = 0, height = 0, nrComponents;
+    for (unsigned int i = 0; i < faces.size(); i++)
+    {
+        TraceScope traceFace("cubemap face", Trace::intern(faces[i].c_str()));
+        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
+        if (data)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+            gpuMemory().uploaded((size_t)width * height * nrComponents);
+            stbi_image_free(data);
+        }
+        else
+        {
+            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+            stbi_image_free(data);
+        }
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    // six faces, no mip chain
+    if (!faces.empty())
+        gpuMemory().allocate(GpuMemory::TEXTURE, textureID, GPU_MEMORY_TEXTURES, faces[0] + " (cubemap)",
+                             GpuMemory::textureBytes(GL_RGB, width, height, 6, 1));
+
+    return textureID;
+}
+#endif
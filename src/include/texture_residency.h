@@ -0,0 +1,496 @@
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gl_state.h"
+#include "gpu_memory.h"
+#include "texture_loader.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <cmath>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Keeps the textures made by loadTexture and TextureFromFile within a video memory budget by dropping
+// and restoring their finest mip levels.
+//
+// Each frame the caller reports, with use(), every tracked texture it draws together with the bounding
+// sphere it is drawn on. update() turns the sphere's projected size into the finest mip level worth
+// having, assuming the texture wraps once around the sphere (equirectangular maps); the level is also
+// computed from where the camera will be PREFETCH_SECONDS from now along its velocity, and the finer of
+// the two is wanted, so textures come in before the camera arrives.
+//
+// Over budget, the levels finer than wanted go first, least recently used textures first; then the
+// needed levels of the least recently used textures. Dropping levels happens in place: the remaining
+// levels are read into a pixel buffer and the texture is respecified smaller from it, so the handle stays
+// valid. Finer levels come back by decoding the file again on a worker thread
+// and uploading it like loadTexture does, at most UPLOADS_PER_FRAME per update(). A texture whose file
+// fails to decode keeps the levels it has and is not reloaded again until it is tracked anew.
+//
+// Textures must be 2D, mipmapped and mutable (glTexImage2D), as those two loaders make them. track()
+// rejects textures with immutable storage (glTexStorage2D: loadCompressedTexture and the baked textures of
+// TextureStreamer), whose levels cannot be respecified. Call untrack() before deleting a texture.
+class TextureResidency
+{
+public:
+    static const unsigned int UPLOADS_PER_FRAME = 1;
+    static constexpr float PREFETCH_SECONDS = 1.0f;
+
+    // statistics
+    unsigned long long levelsDropped;
+    unsigned long long reloads;
+    unsigned long long prefetches; // reloads wanted only because of where the camera is heading
+
+    TextureResidency(size_t budgetBytes)
+        : levelsDropped(0), reloads(0), prefetches(0), budget(budgetBytes), residentBytes(0), reservedBytes(0), frame(1),
+          decoding(0), stopping(false)
+    {
+        worker = std::thread(&TextureResidency::run, this);
+    }
+
+    ~TextureResidency()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+        for (unsigned int i = 0; i < finished.size(); i++)
+            stbi_image_free(finished[i].pixels);
+    }
+
+    // starts managing a texture, path is the file it was loaded from and is read again only to reload
+    // levels; all its levels count as resident
+    void track(unsigned int texture, const std::string& path)
+    {
+        Entry entry;
+        GLint immutable = GL_FALSE;
+        entry.width = 0;
+        entry.height = 0;
+        glState().bindTexture(GL_TEXTURE_2D, texture);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &entry.width);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &entry.height);
+        glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &entry.internalFormat);
+        glGetTexParameteriv(GL_TEXTURE_2D, GL_TEXTURE_IMMUTABLE_FORMAT, &immutable);
+        if (entry.width == 0 || entry.height == 0)
+        {
+            std::cout << "ERROR::TEXTURE_RESIDENCY::NOT_LOADED: " << path << std::endl;
+            return;
+        }
+        if (immutable)
+        {
+            std::cout << "ERROR::TEXTURE_RESIDENCY::IMMUTABLE: " << path << " has glTexStorage storage, its levels cannot be dropped" << std::endl;
+            return;
+        }
+        entry.components = components(entry.internalFormat);
+        if (entry.components == 0)
+        {
+            std::cout << "ERROR::TEXTURE_RESIDENCY::FORMAT: " << path << " has internal format 0x" << std::hex << entry.internalFormat
+                      << std::dec << std::endl;
+            return;
+        }
+        entry.texture = texture;
+        entry.path = path;
+        entry.traceDetail = Trace::intern(path.c_str());
+        entry.levels = 1;
+        while ((std::max(entry.width, entry.height) >> entry.levels) > 0)
+            entry.levels++;
+        entry.resident = 0;
+        entry.wanted = 0;
+        entry.loading = -1;
+        entry.failed = false;
+        entry.prefetch = false;
+        entry.lastUsed = 0;
+        entry.center = glm::vec3(0.0f);
+        entry.radius = 0.0f;
+        index[texture] = entries.size();
+        entries.push_back(entry);
+        residentBytes += bytes(entry, 0);
+    }
+
+    void untrack(unsigned int texture)
+    {
+        std::unordered_map<unsigned int, unsigned int>::iterator found = index.find(texture);
+        if (found == index.end())
+            return;
+        unsigned int i = found->second;
+        residentBytes -= bytes(entries[i], entries[i].resident);
+        if (entries[i].loading >= 0)
+            reservedBytes -= bytes(entries[i], entries[i].loading) - bytes(entries[i], entries[i].resident);
+        index.erase(found);
+        // a reload in flight finds the texture gone
+        if (i + 1 < entries.size())
+        {
+            entries[i] = entries.back();
+            index[entries[i].texture] = i;
+        }
+        entries.pop_back();
+    }
+
+    // this frame draws texture on an object within the bounding sphere center, radius
+    void use(unsigned int texture, const glm::vec3& center, float radius)
+    {
+        std::unordered_map<unsigned int, unsigned int>::iterator found = index.find(texture);
+        if (found == index.end())
+            return;
+        Entry& entry = entries[found->second];
+        entry.center = center;
+        entry.radius = radius;
+        entry.lastUsed = frame;
+    }
+
+    // once per frame after the use() calls: picks the wanted levels, uploads finished reloads, evicts down
+    // to the budget and starts new reloads; fovY in radians, viewportHeight in pixels
+    void update(const glm::vec3& cameraPosition, const glm::vec3& cameraVelocity, float fovY, float viewportHeight)
+    {
+        TraceScope trace("texture residency");
+        float pixelsPerRadian = viewportHeight / (2.0f * std::tan(0.5f * fovY));
+        glm::vec3 ahead = cameraPosition + cameraVelocity * PREFETCH_SECONDS;
+        for (unsigned int i = 0; i < entries.size(); i++)
+        {
+            Entry& entry = entries[i];
+            if (entry.radius <= 0.0f)
+                continue;
+            int aheadLevel = levelFor(entry, glm::length(entry.center - ahead), pixelsPerRadian);
+            entry.prefetch = false;
+            if (entry.lastUsed == frame)
+            {
+                int nowLevel = levelFor(entry, glm::length(entry.center - cameraPosition), pixelsPerRadian);
+                entry.wanted = std::min(nowLevel, aheadLevel);
+                entry.prefetch = aheadLevel < nowLevel;
+            }
+            else if (aheadLevel < entry.resident)
+            {
+                // not drawn now, but the camera is heading for it
+                entry.wanted = aheadLevel;
+                entry.prefetch = true;
+                entry.lastUsed = frame;
+            }
+            else
+                entry.wanted = entry.levels - 1; // not drawn, every level is surplus
+        }
+
+        uploadFinished();
+        evict(residentBytes + reservedBytes > budget ? residentBytes + reservedBytes - budget : 0, ~0ull);
+        requestReloads();
+        frame++;
+    }
+
+    size_t bytesResident() const
+    {
+        return residentBytes;
+    }
+
+    size_t budgetBytes() const
+    {
+        return budget;
+    }
+
+    // bytes every tracked texture would take with all its levels
+    size_t bytesFull() const
+    {
+        size_t total = 0;
+        for (unsigned int i = 0; i < entries.size(); i++)
+            total += bytes(entries[i], 0);
+        return total;
+    }
+
+    // level 0 of the texture is level residentLevel() of the full chain, -1 if not tracked
+    int residentLevel(unsigned int texture) const
+    {
+        std::unordered_map<unsigned int, unsigned int>::const_iterator found = index.find(texture);
+        return found == index.end() ? -1 : entries[found->second].resident;
+    }
+
+    // finishes the reloads in flight, for tests and benchmarks
+    void finish()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [this]() { return queued.empty() && decoding == 0; });
+        lock.unlock();
+        uploadFinished(~0u);
+    }
+
+private:
+    struct Entry {
+        unsigned int texture;
+        std::string path;
+        const char* traceDetail; // path interned for the trace
+        int width, height;    // of the full chain
+        int components;
+        GLint internalFormat;
+        int levels;
+        int resident;         // finest level on the GPU
+        int wanted;           // finest level worth having
+        int loading;          // level being reloaded, -1 if none
+        bool failed;          // a reload could not decode the file, no further reloads
+        bool prefetch;
+        unsigned long long lastUsed;
+        glm::vec3 center;
+        float radius;
+    };
+
+    struct Reload {
+        unsigned int texture;
+        std::string path;
+        const char* traceDetail;
+        int level;
+        unsigned char* pixels;
+        int width, height, components; // of the level, the file is scaled to it
+    };
+
+    size_t budget;
+    size_t residentBytes;
+    size_t reservedBytes; // growth of the reloads in flight
+    unsigned long long frame;
+    std::vector<Entry> entries;
+    std::unordered_map<unsigned int, unsigned int> index;
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    std::deque<Reload> queued;
+    std::vector<Reload> finished;
+    unsigned int decoding;
+    bool stopping;
+
+    // video memory of the levels from level down, at 4 bytes per texel for RGB as drivers store it
+    static size_t bytes(const Entry& entry, int level)
+    {
+        size_t texel = entry.components == 3 ? 4 : entry.components, total = 0;
+        for (int l = level; l < entry.levels; l++)
+            total += (size_t)std::max(entry.width >> l, 1) * std::max(entry.height >> l, 1) * texel;
+        return total;
+    }
+
+    // the coarsest level that still has a texel per pixel across the sphere; its visible half spans half
+    // the texture's width
+    static int levelFor(const Entry& entry, float distance, float pixelsPerRadian)
+    {
+        float pixels = 2.0f * entry.radius / std::max(distance, entry.radius) * pixelsPerRadian;
+        float texels = 0.5f * entry.width;
+        int level = pixels > 0.0f ? (int)std::floor(std::log2(std::max(texels / pixels, 1.0f))) : entry.levels - 1;
+        return std::min(level, entry.levels - 1);
+    }
+
+    // channels of the formats the loaders create, 0 for any other
+    static int components(GLint internalFormat)
+    {
+        switch (internalFormat)
+        {
+        case GL_RED: case GL_R8: return 1;
+        case GL_RG: case GL_RG8: return 2;
+        case GL_RGB: case GL_RGB8: return 3;
+        case GL_RGBA: case GL_RGBA8: return 4;
+        default: return 0;
+        }
+    }
+
+    static GLenum pixelFormat(int components)
+    {
+        return components == 1 ? GL_RED : components == 2 ? GL_RG : components == 4 ? GL_RGBA : GL_RGB;
+    }
+
+    // frees at least bytesNeeded by dropping levels: first levels finer than wanted of any texture, then
+    // needed levels of textures used before the given frame, least recently used first within each pass
+    void evict(size_t bytesNeeded, unsigned long long before)
+    {
+        if (bytesNeeded == 0)
+            return;
+        std::vector<unsigned int> order;
+        for (unsigned int i = 0; i < entries.size(); i++)
+            if (entries[i].loading < 0)
+                order.push_back(i);
+        std::stable_sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) { return entries[a].lastUsed < entries[b].lastUsed; });
+        size_t freed = 0;
+        for (unsigned int pass = 0; pass < 2 && freed < bytesNeeded; pass++)
+            for (unsigned int i = 0; i < order.size() && freed < bytesNeeded; i++)
+            {
+                Entry& entry = entries[order[i]];
+                if (pass == 1 && entry.lastUsed >= before)
+                    break;
+                int floor = pass == 0 ? entry.wanted : entry.levels - 1;
+                while (entry.resident < floor && freed < bytesNeeded)
+                {
+                    size_t held = bytes(entry, entry.resident);
+                    dropLevel(entry);
+                    freed += held - bytes(entry, entry.resident);
+                }
+            }
+    }
+
+    // moves the texture's level 1 and below up to level 0 and releases the old level 0; the levels make a
+    // round trip through a pixel buffer, which stays on the GPU and, unlike glCopyImageSubData, takes the
+    // unsized formats the loaders create
+    void dropLevel(Entry& entry)
+    {
+        TraceScope trace("drop mip level", entry.traceDetail);
+        int oldLevels = entry.levels - entry.resident, newLevels = oldLevels - 1;
+        int width = std::max(entry.width >> (entry.resident + 1), 1), height = std::max(entry.height >> (entry.resident + 1), 1);
+        GLenum format = pixelFormat(entry.components);
+        std::vector<GLintptr> offsets(newLevels + 1, 0);
+        for (int l = 0; l < newLevels; l++)
+            offsets[l + 1] = offsets[l] + (GLintptr)std::max(width >> l, 1) * std::max(height >> l, 1) * entry.components;
+
+        unsigned int staging;
+        glGenBuffers(1, &staging);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, staging);
+        glBufferData(GL_PIXEL_PACK_BUFFER, offsets[newLevels], NULL, GL_STREAM_COPY);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glState().bindTexture(GL_TEXTURE_2D, entry.texture);
+        for (int l = 0; l < newLevels; l++)
+            glGetTexImage(GL_TEXTURE_2D, l + 1, format, GL_UNSIGNED_BYTE, (void*)offsets[l]);
+        glPixelStorei(GL_PACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, staging);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        for (int l = 0; l < oldLevels; l++)
+        {
+            if (l < newLevels)
+                glTexImage2D(GL_TEXTURE_2D, l, entry.internalFormat, std::max(width >> l, 1), std::max(height >> l, 1), 0, format,
+                             GL_UNSIGNED_BYTE, (void*)offsets[l]);
+            else
+                glTexImage2D(GL_TEXTURE_2D, l, entry.internalFormat, 0, 0, 0, format, GL_UNSIGNED_BYTE, NULL);
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &staging);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, newLevels - 1);
+
+        residentBytes -= bytes(entry, entry.resident) - bytes(entry, entry.resident + 1);
+        entry.resident++;
+        gpuMemory().resize(GpuMemory::TEXTURE, entry.texture, bytes(entry, entry.resident));
+        levelsDropped++;
+    }
+
+    // queues reloads of textures missing wanted levels, most recently used first, as far as the budget
+    // allows after evicting textures used longer ago
+    void requestReloads()
+    {
+        std::vector<unsigned int> order;
+        for (unsigned int i = 0; i < entries.size(); i++)
+            if (entries[i].loading < 0 && !entries[i].failed && entries[i].wanted < entries[i].resident)
+                order.push_back(i);
+        std::stable_sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) { return entries[a].lastUsed > entries[b].lastUsed; });
+        for (unsigned int i = 0; i < order.size(); i++)
+        {
+            Entry& entry = entries[order[i]];
+            int level = entry.wanted;
+            size_t growth = bytes(entry, level) - bytes(entry, entry.resident);
+            if (residentBytes + reservedBytes + growth > budget)
+                evict(residentBytes + reservedBytes + growth - budget, entry.lastUsed);
+            // settle for a coarser level than wanted if that is all that fits
+            while (level < entry.resident && residentBytes + reservedBytes + bytes(entry, level) - bytes(entry, entry.resident) > budget)
+                level++;
+            if (level >= entry.resident)
+                continue;
+            reservedBytes += bytes(entry, level) - bytes(entry, entry.resident);
+            entry.loading = level;
+            if (entry.prefetch)
+                prefetches++;
+            Reload reload = { entry.texture, entry.path, entry.traceDetail, level, NULL, std::max(entry.width >> level, 1),
+                              std::max(entry.height >> level, 1), entry.components };
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                queued.push_back(reload);
+            }
+            wake.notify_one();
+        }
+    }
+
+    // GL thread: level 0 from the decoded image, the rest generated like loadTexture does
+    void uploadFinished(unsigned int limit = UPLOADS_PER_FRAME)
+    {
+        std::vector<Reload> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            unsigned int count = std::min((unsigned int)finished.size(), limit);
+            ready.assign(finished.begin(), finished.begin() + count);
+            finished.erase(finished.begin(), finished.begin() + count);
+        }
+        for (unsigned int i = 0; i < ready.size(); i++)
+        {
+            Reload& reload = ready[i];
+            std::unordered_map<unsigned int, unsigned int>::iterator found = index.find(reload.texture);
+            if (found != index.end() && entries[found->second].loading == reload.level)
+            {
+                Entry& entry = entries[found->second];
+                size_t growth = bytes(entry, reload.level) - bytes(entry, entry.resident);
+                reservedBytes -= growth;
+                entry.loading = -1;
+                if (reload.pixels)
+                {
+                    TraceScope trace("restore mip levels", entry.traceDetail);
+                    GLenum format = pixelFormat(reload.components);
+                    glState().bindTexture(GL_TEXTURE_2D, entry.texture);
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+                    glTexImage2D(GL_TEXTURE_2D, 0, entry.internalFormat, reload.width, reload.height, 0, format, GL_UNSIGNED_BYTE, reload.pixels);
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, entry.levels - reload.level - 1);
+                    glGenerateMipmap(GL_TEXTURE_2D);
+                    residentBytes += growth;
+                    entry.resident = reload.level;
+                    gpuMemory().resize(GpuMemory::TEXTURE, entry.texture, bytes(entry, entry.resident));
+                    gpuMemory().uploaded((size_t)reload.width * reload.height * reload.components);
+                    reloads++;
+                }
+                else
+                    entry.failed = true;
+            }
+            stbi_image_free(reload.pixels);
+        }
+    }
+
+    // worker thread: decodes the file and scales it to the size of the requested level, which the file
+    // need not have at level 0 (loaders may have resampled it)
+    void run()
+    {
+        for (;;)
+        {
+            Reload reload;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                wake.wait(lock, [this]() { return stopping || !queued.empty(); });
+                if (stopping)
+                    return;
+                reload = queued.front();
+                queued.pop_front();
+                decoding++;
+                lock.unlock();
+
+                TraceScope trace("reload texture", reload.traceDetail);
+                const std::string& path = reload.path;
+                int components = reload.components;
+                int width, height, fileComponents;
+                unsigned char* data = stbi_load(path.c_str(), &width, &height, &fileComponents, components);
+                if (data && (width != reload.width || height != reload.height))
+                {
+                    unsigned char* scaled = static_cast<unsigned char*>(malloc((size_t)reload.width * reload.height * components));
+                    resampleImage(data, width, height, scaled, reload.width, reload.height, components);
+                    stbi_image_free(data);
+                    data = scaled;
+                }
+                if (!data)
+                    std::cout << "Texture failed to load at path: " << path << std::endl;
+                reload.pixels = data;
+
+                lock.lock();
+                finished.push_back(reload);
+                decoding--;
+            }
+            done.notify_all();
+        }
+    }
+};
+#endif
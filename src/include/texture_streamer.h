@@ -0,0 +1,597 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gl_state.h"
+#include "gpu_memory.h"
+#include "ktx2.h"
+#include "texture_loader.h"
+#include "trace.h"
+
+// Asynchronous counterpart of loadTexture, loadTextureArray and loadCubemap.
+//
+// The load functions return the texture name at once and queue one decode job per image. A pool of worker
+// threads decodes (and resamples array layers) in parallel; the GL thread only copies finished images into
+// persistently mapped staging buffers and issues the glTex(Sub)Image call from the bound pixel unpack buffer,
+// so the driver copies to the texture without stalling the caller. A fence after each upload tells when its
+// staging buffer may be reused. If no staging buffer can be mapped while none is in flight, the image is
+// uploaded straight from client memory instead, so finish() always makes progress.
+//
+// Paths ending in .ktx2 are textures baked by TextureBaker: the workers only read the file, and the stored
+// block-compressed mip chain is uploaded with glCompressedTex(Sub)Image. Array layers and cubemap faces are
+// either all baked or all plain images. A baked array layer larger than the others starts at the mip level
+// of their size.
+//
+// update() does that work for at most a byte budget per call, once per frame; finish() runs until every
+// queued image has been uploaded. A texture gets its mipmaps and filters when its last image is uploaded and
+// is complete from then on (GL orders the uploads before any later draw). Until then it samples as black.
+class TextureStreamer
+{
+public:
+    static const GLsizeiptr FRAME_UPLOAD_BUDGET = 16 << 20; // bytes per update() call
+    static const GLsizeiptr STAGING_LIMIT = 96 << 20;       // staging memory while uploads are in flight
+
+    // statistics
+    unsigned long long bytesUploaded;
+    unsigned long long stagingStalls; // uploads postponed because every staging buffer was in flight
+    unsigned long long directUploads; // uploads from client memory because no staging buffer could be mapped
+
+    // threads 0: one less than the hardware threads, the GL thread keeps one
+    TextureStreamer(unsigned int threads = 0)
+        : bytesUploaded(0), stagingStalls(0), directUploads(0), stopping(false), decoding(0), stagingBytes(0)
+    {
+        if (threads == 0)
+            threads = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+        for (unsigned int i = 0; i < threads; i++)
+            workers.push_back(std::thread(&TextureStreamer::run, this, i));
+    }
+
+    ~TextureStreamer()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (unsigned int i = 0; i < workers.size(); i++)
+            workers[i].join();
+        for (unsigned int i = 0; i < queued.size(); i++)
+            delete queued[i];
+        for (unsigned int i = 0; i < finished.size(); i++)
+            release(finished[i]);
+        for (unsigned int i = 0; i < decoded.size(); i++)
+            release(decoded[i]);
+        for (unsigned int i = 0; i < staging.size(); i++)
+            destroy(staging[i]);
+    }
+
+    unsigned int loadTexture(const std::string& path)
+    {
+        unsigned int texture = create(GL_TEXTURE_2D, 1);
+        queue(texture, GL_TEXTURE_2D, 0, path, 0, 0, 0);
+        return texture;
+    }
+
+    unsigned int loadTextureArray(const std::vector<std::string>& paths)
+    {
+        unsigned int texture = create(GL_TEXTURE_2D_ARRAY, paths.size());
+        glState().bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+        int width = 1, height = 1;
+        if (!paths.empty() && isBaked(paths[0]))
+        {
+            // the smallest layer sets the size, all layers share the format of the first
+            uint32_t vkFormat = 0, levels = 32;
+            for (unsigned int i = 0; i < paths.size(); i++)
+            {
+                uint32_t layerFormat, layerWidth, layerHeight, layerLevels;
+                if (!readKtx2Info(paths[i], layerFormat, layerWidth, layerHeight, layerLevels))
+                    continue;
+                if (vkFormat == 0 || (int)layerWidth < width)
+                {
+                    width = layerWidth;
+                    height = layerHeight;
+                }
+                vkFormat = vkFormat ? vkFormat : layerFormat;
+                levels = std::min(levels, layerLevels);
+            }
+            glTexStorage3D(GL_TEXTURE_2D_ARRAY, levels, compressedInternalFormat(vkFormat), width, height, paths.size());
+            textures[texture].compressed = true;
+            textures[texture].vkFormat = vkFormat;
+            gpuMemory().allocate(GpuMemory::TEXTURE, texture, GPU_MEMORY_TEXTURES, textureArrayName(paths),
+                                 GpuMemory::textureBytes(compressedInternalFormat(vkFormat), width, height, paths.size(), levels));
+        }
+        else
+        {
+            textureArrayLayerSize(paths, width, height);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGB8, width, height, paths.size(), 0, GL_RGB, GL_UNSIGNED_BYTE, NULL);
+            // with the mip chain generated by complete()
+            gpuMemory().allocate(GpuMemory::TEXTURE, texture, GPU_MEMORY_TEXTURES, textureArrayName(paths),
+                                 GpuMemory::textureBytes(GL_RGB8, width, height, paths.size(), GpuMemory::mipLevels(width, height)));
+        }
+        textures[texture].allocated = true;
+        for (unsigned int i = 0; i < paths.size(); i++)
+            queue(texture, GL_TEXTURE_2D_ARRAY, i, paths[i], width, height, 3);
+        return texture;
+    }
+
+    // faces in the order of loadCubemap
+    unsigned int loadCubemap(const std::vector<std::string>& faces)
+    {
+        unsigned int texture = create(GL_TEXTURE_CUBE_MAP, faces.size());
+        uint32_t vkFormat, width, height, levels;
+        if (!faces.empty() && isBaked(faces[0]) && readKtx2Info(faces[0], vkFormat, width, height, levels))
+        {
+            glState().bindTexture(GL_TEXTURE_CUBE_MAP, texture);
+            glTexStorage2D(GL_TEXTURE_CUBE_MAP, levels, compressedInternalFormat(vkFormat), width, height);
+            textures[texture].compressed = true;
+            textures[texture].vkFormat = vkFormat;
+            textures[texture].allocated = true;
+            gpuMemory().allocate(GpuMemory::TEXTURE, texture, GPU_MEMORY_TEXTURES, faces[0] + " (cubemap)",
+                                 GpuMemory::textureBytes(compressedInternalFormat(vkFormat), width, height, 6, levels));
+        }
+        for (unsigned int i = 0; i < faces.size(); i++)
+            queue(texture, GL_TEXTURE_CUBE_MAP, i, faces[i], 0, 0, 3);
+        return texture;
+    }
+
+    // GL thread: uploads decoded images for at most budget bytes and recycles the staging buffers the GPU is done with
+    void update(GLsizeiptr budget = FRAME_UPLOAD_BUDGET)
+    {
+        recycle();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            decoded.insert(decoded.end(), finished.begin(), finished.end());
+            finished.clear();
+        }
+        GLsizeiptr uploaded = 0;
+        unsigned int count = 0;
+        while (count < decoded.size() && uploaded < budget)
+        {
+            Job* job = decoded[count];
+            GLsizeiptr bytes = imageBytes(*job);
+            if (bytes > 0 && !upload(*job, bytes))
+            {
+                stagingStalls++;
+                break;
+            }
+            uploaded += bytes;
+            complete(*job);
+            release(job);
+            count++;
+        }
+        decoded.erase(decoded.begin(), decoded.begin() + count);
+        if (count > 0)
+            glFlush(); // start the copies now rather than at the next swap
+    }
+
+    // GL thread: blocks until every queued image is uploaded
+    void finish()
+    {
+        while (pending() > 0)
+        {
+            update(STAGING_LIMIT);
+            std::unique_lock<std::mutex> lock(mutex);
+            if (finished.empty() && (!queued.empty() || decoding > 0))
+                done.wait(lock);
+            else if (finished.empty() && !decoded.empty())
+            {
+                lock.unlock();
+                waitForStaging();
+            }
+        }
+    }
+
+    // images not uploaded yet
+    unsigned int pending()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return queued.size() + decoding + finished.size() + decoded.size();
+    }
+
+private:
+    struct Job {
+        unsigned int texture;
+        GLenum target;
+        unsigned int layer;
+        std::string path;
+        const char* traceDetail; // path interned for the trace
+        int width, height;  // array layers are resampled to this size, 0 keeps the image size
+        int components;     // 0 keeps the image's
+        unsigned char* pixels;
+        bool resampled;     // pixels is new[]ed, not stbi_load'ed
+        Ktx2Image* baked;   // instead of pixels for .ktx2 files
+        unsigned int firstLevel; // level of the baked chain that becomes level 0
+    };
+
+    struct Staging {
+        unsigned int buffer;
+        GLsizeiptr size;
+        void* mapped;
+        GLsync fence; // last upload from this buffer, 0 if free
+    };
+
+    struct Texture {
+        GLenum target;
+        unsigned int remaining; // images not uploaded yet
+        bool allocated;         // has storage, glGenerateMipmap would fail without
+        bool compressed;        // baked mip chain, nothing to generate
+        uint32_t vkFormat;      // storage format of baked arrays and cubemaps, every layer must match it
+    };
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    bool stopping;
+    std::deque<Job*> queued;     // waiting for a worker
+    unsigned int decoding;       // taken by a worker
+    std::vector<Job*> finished;  // decoded, not seen by the GL thread yet
+    // GL thread only
+    std::vector<Job*> decoded;
+    std::vector<Staging> staging;
+    GLsizeiptr stagingBytes;
+    std::map<unsigned int, Texture> textures;
+
+    unsigned int create(GLenum target, unsigned int images)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        Texture texture = { target, images, false, false, 0 };
+        if (images > 0)
+            textures[textureID] = texture;
+        return textureID;
+    }
+
+    void queue(unsigned int texture, GLenum target, unsigned int layer, const std::string& path, int width, int height, int components)
+    {
+        Job* job = new Job();
+        job->texture = texture;
+        job->target = target;
+        job->layer = layer;
+        job->path = path;
+        job->traceDetail = Trace::intern(path.c_str());
+        job->width = width;
+        job->height = height;
+        job->components = components;
+        job->pixels = NULL;
+        job->resampled = false;
+        job->baked = NULL;
+        job->firstLevel = 0;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            queued.push_back(job);
+        }
+        wake.notify_one();
+    }
+
+    void run(unsigned int index)
+    {
+        std::string name = "texture decode " + std::to_string(index);
+        Trace::setThreadName(name.c_str());
+        for (;;)
+        {
+            Job* job;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (queued.empty() && !stopping)
+                    wake.wait(lock);
+                if (stopping)
+                    return;
+                job = queued.front();
+                queued.pop_front();
+                decoding++;
+            }
+            decode(*job);
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                decoding--;
+                finished.push_back(job);
+            }
+            done.notify_all();
+        }
+    }
+
+    static bool isBaked(const std::string& path)
+    {
+        return path.size() > 5 && path.compare(path.size() - 5, 5, ".ktx2") == 0;
+    }
+
+    static GLsizeiptr imageBytes(const Job& job)
+    {
+        if (job.pixels)
+            return (GLsizeiptr)job.width * job.height * job.components;
+        GLsizeiptr bytes = 0;
+        if (job.baked)
+            for (unsigned int i = job.firstLevel; i < job.baked->levels.size(); i++)
+                bytes += job.baked->levels[i].size();
+        return bytes;
+    }
+
+    // worker thread
+    static void decode(Job& job)
+    {
+        TraceScope trace("decode", job.traceDetail);
+        if (isBaked(job.path))
+        {
+            job.baked = new Ktx2Image();
+            if (!readKtx2(job.path, *job.baked))
+            {
+                delete job.baked;
+                job.baked = NULL;
+                return;
+            }
+            // array layers: skip the levels larger than the layer size
+            while (job.width > 0 && (int)(job.baked->width >> job.firstLevel) > job.width && job.firstLevel + 1 < job.baked->levels.size())
+                job.firstLevel++;
+            job.width = std::max(job.baked->width >> job.firstLevel, 1u);
+            job.height = std::max(job.baked->height >> job.firstLevel, 1u);
+            return;
+        }
+        int width, height, nrComponents;
+        job.pixels = stbi_load(job.path.c_str(), &width, &height, &nrComponents, job.components);
+        if (!job.pixels)
+            return;
+        if (job.components == 0)
+            job.components = nrComponents;
+        if (job.width > 0 && (width != job.width || height != job.height))
+        {
+            unsigned char* resampled = new unsigned char[(size_t)job.width * job.height * job.components];
+            resampleImage(job.pixels, width, height, resampled, job.width, job.height, job.components);
+            stbi_image_free(job.pixels);
+            job.pixels = resampled;
+            job.resampled = true;
+            return;
+        }
+        job.width = width;
+        job.height = height;
+    }
+
+    static void release(Job* job)
+    {
+        delete job->baked;
+        if (job->resampled)
+            delete[] job->pixels;
+        else
+            stbi_image_free(job->pixels);
+        delete job;
+    }
+
+    // copies the image into a staging buffer and starts the transfer, false if no staging buffer is free
+    bool upload(const Job& job, GLsizeiptr bytes)
+    {
+        Staging* buffer = acquire(bytes);
+        Staging direct = { 0, bytes, NULL, 0 };
+        if (!buffer)
+        {
+            // waiting only helps while a fence will free a buffer; otherwise mapping failed, upload unstaged
+            if (inFlight())
+                return false;
+            buffer = &direct;
+            directUploads++;
+        }
+        TraceScope trace("upload", job.traceDetail);
+        if (job.baked)
+        {
+            uint32_t storage = textures[job.texture].vkFormat;
+            if (storage != 0 && storage != job.baked->vkFormat)
+                std::cout << "ERROR::TEXTURE_STREAMER::FORMAT_MISMATCH: " << job.path << " is not baked like the other layers" << std::endl;
+            else
+                uploadBaked(job, *buffer);
+            return true;
+        }
+        const void* source = job.pixels;
+        if (buffer->buffer)
+        {
+            std::memcpy(buffer->mapped, job.pixels, bytes);
+            source = (void*)0;
+        }
+
+        static const GLenum FORMATS[5] = { GL_RGB, GL_RED, GL_RG, GL_RGB, GL_RGBA };
+        GLenum format = FORMATS[job.components];
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->buffer);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // RGB rows of odd widths are not 4 byte aligned
+        glState().bindTexture(job.target, job.texture);
+        if (job.target == GL_TEXTURE_2D_ARRAY)
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, job.layer, job.width, job.height, 1, format, GL_UNSIGNED_BYTE, source);
+        else if (job.target == GL_TEXTURE_CUBE_MAP)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + job.layer, 0, GL_RGB, job.width, job.height, 0, format, GL_UNSIGNED_BYTE, source);
+            if (job.layer == 0)
+                gpuMemory().allocate(GpuMemory::TEXTURE, job.texture, GPU_MEMORY_TEXTURES, job.path + " (cubemap)",
+                                     GpuMemory::textureBytes(GL_RGB, job.width, job.height, 6, 1));
+        }
+        else
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, format, job.width, job.height, 0, format, GL_UNSIGNED_BYTE, source);
+            // with the mip chain generated by complete()
+            gpuMemory().allocate(GpuMemory::TEXTURE, job.texture, GPU_MEMORY_TEXTURES, job.path,
+                                 GpuMemory::textureBytes(format, job.width, job.height, 1, GpuMemory::mipLevels(job.width, job.height)));
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (buffer->buffer)
+            buffer->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        bytesUploaded += bytes;
+        gpuMemory().uploaded(bytes);
+        return true;
+    }
+
+    // one glCompressedTex(Sub)Image per mip level, from consecutive ranges of the staging buffer, or from the
+    // image itself for a buffer without a GL name
+    void uploadBaked(const Job& job, Staging& buffer)
+    {
+        const Ktx2Image& image = *job.baked;
+        GLenum format = compressedInternalFormat(image.vkFormat);
+        unsigned int levels = image.levels.size() - job.firstLevel;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.buffer);
+        glState().bindTexture(job.target, job.texture);
+        if (job.target == GL_TEXTURE_2D)
+        {
+            glTexStorage2D(GL_TEXTURE_2D, levels, format, job.width, job.height);
+            textures[job.texture].compressed = true;
+            gpuMemory().allocate(GpuMemory::TEXTURE, job.texture, GPU_MEMORY_TEXTURES, job.path,
+                                 GpuMemory::textureBytes(format, job.width, job.height, 1, levels));
+        }
+        GLint storedLevels = levels;
+        if (job.target != GL_TEXTURE_2D)
+            glGetTexParameteriv(job.target, GL_TEXTURE_IMMUTABLE_LEVELS, &storedLevels);
+        size_t offset = 0;
+        for (unsigned int level = 0; level < levels && (GLint)level < storedLevels; level++)
+        {
+            const std::vector<unsigned char>& data = image.levels[job.firstLevel + level];
+            const void* source = &data[0];
+            if (buffer.buffer)
+            {
+                std::memcpy(static_cast<char*>(buffer.mapped) + offset, &data[0], data.size());
+                source = (void*)offset;
+            }
+            GLsizei width = std::max(job.width >> level, 1), height = std::max(job.height >> level, 1);
+            if (job.target == GL_TEXTURE_2D_ARRAY)
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, job.layer, width, height, 1, format, data.size(), source);
+            else if (job.target == GL_TEXTURE_CUBE_MAP)
+                glCompressedTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + job.layer, level, 0, 0, width, height, format, data.size(), source);
+            else
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, width, height, format, data.size(), source);
+            offset += data.size();
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (buffer.buffer)
+            buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        bytesUploaded += offset;
+        gpuMemory().uploaded(offset);
+    }
+
+    // counts an image as uploaded (or failed), and finishes its texture after the last one
+    void complete(const Job& job)
+    {
+        bool loaded = job.pixels || job.baked;
+        if (!loaded)
+            std::cout << "Texture failed to load at path: " << job.path << std::endl;
+        std::map<unsigned int, Texture>::iterator texture = textures.find(job.texture);
+        if (texture == textures.end())
+            return;
+        texture->second.allocated |= loaded;
+        if (--texture->second.remaining > 0)
+            return;
+        GLenum target = texture->second.target;
+        if (!texture->second.allocated)
+        {
+            textures.erase(texture);
+            return;
+        }
+        glState().bindTexture(target, job.texture);
+        if (target == GL_TEXTURE_CUBE_MAP)
+        {
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        }
+        else
+        {
+            if (!texture->second.compressed)
+                glGenerateMipmap(target);
+            glTexParameteri(target, GL_TEXTURE_WRAP_S, GL_REPEAT);
+            glTexParameteri(target, GL_TEXTURE_WRAP_T, GL_REPEAT);
+            glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+            glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        }
+        textures.erase(texture);
+    }
+
+    // a free staging buffer of at least bytes, NULL if the staging memory is all in flight
+    Staging* acquire(GLsizeiptr bytes)
+    {
+        for (unsigned int i = 0; i < staging.size(); i++)
+            if (!staging[i].fence && staging[i].size >= bytes)
+                return &staging[i];
+        // make room: free buffers that are too small go first
+        for (unsigned int i = staging.size(); i-- > 0 && stagingBytes + bytes > STAGING_LIMIT;)
+            if (!staging[i].fence)
+            {
+                destroy(staging[i]);
+                staging.erase(staging.begin() + i);
+            }
+        // a single image larger than the limit still gets a buffer once nothing else is in flight
+        if (stagingBytes + bytes > STAGING_LIMIT && !staging.empty())
+            return NULL;
+
+        Staging buffer;
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes, NULL, flags);
+        buffer.mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        buffer.size = bytes;
+        buffer.fence = 0;
+        if (!buffer.mapped)
+        {
+            std::cout << "ERROR::TEXTURE_STREAMER::MAP_FAILED: " << bytes << " bytes" << std::endl;
+            glDeleteBuffers(1, &buffer.buffer);
+            return NULL;
+        }
+        gpuMemory().allocate(GpuMemory::BUFFER, buffer.buffer, GPU_MEMORY_STREAMING, "texture streamer staging", bytes);
+        stagingBytes += bytes;
+        staging.push_back(buffer);
+        return &staging.back();
+    }
+
+    void destroy(Staging& buffer)
+    {
+        if (buffer.fence)
+            glDeleteSync(buffer.fence);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        gpuMemory().release(GpuMemory::BUFFER, buffer.buffer);
+        glDeleteBuffers(1, &buffer.buffer);
+        stagingBytes -= buffer.size;
+    }
+
+    // frees the staging buffers whose uploads have completed, without waiting
+    void recycle()
+    {
+        for (unsigned int i = 0; i < staging.size(); i++)
+            if (staging[i].fence && glClientWaitSync(staging[i].fence, 0, 0) != GL_TIMEOUT_EXPIRED)
+            {
+                glDeleteSync(staging[i].fence);
+                staging[i].fence = 0;
+            }
+    }
+
+    // true while any staging buffer has an unsignalled fence
+    bool inFlight() const
+    {
+        for (unsigned int i = 0; i < staging.size(); i++)
+            if (staging[i].fence)
+                return true;
+        return false;
+    }
+
+    // waits for one of the uploads in flight, only finish() blocks like this
+    void waitForStaging()
+    {
+        for (unsigned int i = 0; i < staging.size(); i++)
+            if (staging[i].fence)
+            {
+                while (glClientWaitSync(staging[i].fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED)
+                    ;
+                return;
+            }
+    }
+};
+#endif
@@ -0,0 +1,265 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+// Begin/end events for a timeline of startup and frames, written as Chrome trace JSON (chrome://tracing,
+// ui.perfetto.dev).
+//
+// Every thread records into its own ring buffer of the last TraceBuffer::CAPACITY events, with no locks and no
+// allocation; the buffer is created and published, with the thread's name, on its first event or on
+// setThreadName(). Names must be string literals. Details (file paths) must be literals or come from
+// Trace::intern(), called where the path is first known (a texture tracked, a job queued) rather than per
+// event. While tracing is off, a TraceScope costs the test of one global bool.
+struct TraceEvent {
+    const char* name;
+    const char* detail; // NULL or interned
+    uint64_t timestamp; // nanoseconds since the trace epoch
+    char phase;         // 'B' or 'E'
+};
+
+class TraceBuffer
+{
+public:
+    static const unsigned int CAPACITY = 1 << 16;
+
+    // set before the buffer is published to other threads, constant afterwards
+    const unsigned int threadId;
+    const std::string threadName;
+
+    TraceBuffer(unsigned int threadId, const std::string& threadName) : threadId(threadId), threadName(threadName), head(0), slots(CAPACITY) {}
+
+    // owning thread only. The slot's sequence is cleared while its fields change and then set to the
+    // event's index + 1, so a reader can tell a complete event from one being overwritten.
+    void record(const char* name, const char* detail, char phase, uint64_t timestamp)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        Slot& slot = slots[h & (CAPACITY - 1)];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.name.store(name, std::memory_order_relaxed);
+        slot.detail.store(detail, std::memory_order_relaxed);
+        slot.timestamp.store(timestamp, std::memory_order_relaxed);
+        slot.phase.store(phase, std::memory_order_relaxed);
+        slot.sequence.store(h + 1, std::memory_order_release);
+        head.store(h + 1, std::memory_order_release);
+    }
+
+    // any thread: the events still in the ring, oldest first. Events the owner overwrote while they were
+    // being copied are dropped.
+    void snapshot(std::vector<TraceEvent>& out) const
+    {
+        uint64_t end = head.load(std::memory_order_acquire);
+        uint64_t begin = end > CAPACITY ? end - CAPACITY : 0;
+        out.clear();
+        for (uint64_t i = begin; i < end; i++)
+        {
+            const Slot& slot = slots[i & (CAPACITY - 1)];
+            if (slot.sequence.load(std::memory_order_acquire) != i + 1)
+                continue;
+            TraceEvent event;
+            event.name = slot.name.load(std::memory_order_relaxed);
+            event.detail = slot.detail.load(std::memory_order_relaxed);
+            event.timestamp = slot.timestamp.load(std::memory_order_relaxed);
+            event.phase = slot.phase.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.sequence.load(std::memory_order_relaxed) == i + 1)
+                out.push_back(event);
+        }
+    }
+
+private:
+    // one TraceEvent, field by field, so that reading it while the owner writes is not a data race
+    struct Slot {
+        std::atomic<uint64_t> sequence; // index + 1 of the complete event held, 0 while written
+        std::atomic<const char*> name;
+        std::atomic<const char*> detail;
+        std::atomic<uint64_t> timestamp;
+        std::atomic<char> phase;
+    };
+
+    std::atomic<uint64_t> head;
+    std::vector<Slot> slots; // value-initialized, so every sequence starts at 0
+};
+
+// state shared by every translation unit without needing a .cpp file to define it
+template<typename Unused = void>
+struct TraceState {
+    static bool enabled;
+    static std::chrono::steady_clock::time_point epoch;
+};
+template<typename Unused> bool TraceState<Unused>::enabled = false;
+template<typename Unused> std::chrono::steady_clock::time_point TraceState<Unused>::epoch = std::chrono::steady_clock::now();
+
+class Trace
+{
+public:
+    // call before the threads to be traced start recording
+    static void enable()
+    {
+        TraceState<>::enabled = true;
+    }
+
+    static bool enabled()
+    {
+        return TraceState<>::enabled;
+    }
+
+    // label of the calling thread in the trace viewer; call before the thread's first event, later calls
+    // are ignored as the buffer is already published without a name
+    static void setThreadName(const char* name)
+    {
+        if (enabled() && !current())
+            registerThread(name);
+    }
+
+    // a copy of text that lives as long as the process, for use as an event detail; NULL while tracing is
+    // off. Takes a lock, so call it when the detail is registered, not for every event.
+    static const char* intern(const char* text)
+    {
+        if (!enabled() || !text)
+            return NULL;
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        return registry().strings.insert(text).first->c_str();
+    }
+
+    // detail must be a literal or come from intern()
+    static void begin(const char* name, const char* detail = NULL)
+    {
+        buffer()->record(name, detail, 'B', now());
+    }
+
+    static void end(const char* name)
+    {
+        buffer()->record(name, NULL, 'E', now());
+    }
+
+    // writes the events recorded so far by every thread; safe while other threads keep recording
+    static bool writeChromeJson(const std::string& path)
+    {
+        FILE* file = std::fopen(path.c_str(), "w");
+        if (!file)
+        {
+            std::printf("ERROR::TRACE::FILE_NOT_SUCCESFULLY_WRITTEN: %s\n", path.c_str());
+            return false;
+        }
+        std::fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+        bool first = true;
+        std::vector<TraceBuffer*> buffers;
+        {
+            std::lock_guard<std::mutex> lock(registry().mutex);
+            buffers = registry().buffers;
+        }
+        for (unsigned int b = 0; b < buffers.size(); b++)
+        {
+            const TraceBuffer& buffer = *buffers[b];
+            if (!buffer.threadName.empty())
+            {
+                std::fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":\"%s\"}}",
+                             first ? "" : ",\n", buffer.threadId, escape(buffer.threadName.c_str()).c_str());
+                first = false;
+            }
+            std::vector<TraceEvent> events;
+            buffer.snapshot(events);
+            unsigned int depth = 0;
+            for (unsigned int i = 0; i < events.size(); i++)
+            {
+                const TraceEvent& event = events[i];
+                // the ring may have dropped the begin of the oldest scopes
+                if (event.phase == 'E' && depth == 0)
+                    continue;
+                depth += event.phase == 'B' ? 1 : -1;
+                std::fprintf(file, "%s{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%u",
+                             first ? "" : ",\n", event.name, event.phase, event.timestamp * 1.0e-3, buffer.threadId);
+                if (event.detail)
+                    std::fprintf(file, ",\"args\":{\"detail\":\"%s\"}", escape(event.detail).c_str());
+                std::fprintf(file, "}");
+                first = false;
+            }
+        }
+        std::fprintf(file, "\n]}\n");
+        std::fclose(file);
+        return true;
+    }
+
+private:
+    struct Registry {
+        std::mutex mutex;
+        std::vector<TraceBuffer*> buffers; // never freed, a thread's events outlive the thread
+        std::set<std::string> strings;
+    };
+
+    static Registry& registry()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    static uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - TraceState<>::epoch).count();
+    }
+
+    static TraceBuffer*& current()
+    {
+        static thread_local TraceBuffer* buffer = NULL;
+        return buffer;
+    }
+
+    static TraceBuffer* buffer()
+    {
+        TraceBuffer* buffer = current();
+        return buffer ? buffer : registerThread("");
+    }
+
+    // creates the calling thread's buffer, named, and only then makes it visible to writeChromeJson()
+    static TraceBuffer* registerThread(const char* name)
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        TraceBuffer* buffer = new TraceBuffer(registry().buffers.size() + 1, name);
+        registry().buffers.push_back(buffer);
+        current() = buffer;
+        return buffer;
+    }
+
+    static std::string escape(const char* text)
+    {
+        std::string escaped;
+        for (; *text; text++)
+        {
+            if (*text == '"' || *text == '\\')
+                escaped += '\\';
+            if ((unsigned char)*text >= 0x20)
+                escaped += *text;
+        }
+        return escaped;
+    }
+};
+
+// records the enclosing block as one begin/end pair
+class TraceScope
+{
+public:
+    explicit TraceScope(const char* name, const char* detail = NULL) : name(TraceState<>::enabled ? name : NULL)
+    {
+        if (this->name)
+            Trace::begin(name, detail);
+    }
+
+    ~TraceScope()
+    {
+        if (name)
+            Trace::end(name);
+    }
+
+private:
+    const char* name;
+};
+#endif
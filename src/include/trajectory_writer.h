@@ -0,0 +1,215 @@
+#ifndef TRAJECTORY_WRITER_H
+#define TRAJECTORY_WRITER_H
+
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "orbit.h"
+#include "spsc_queue.h"
+#include "trace.h"
+
+// Streams the position and velocity of every body to disk for offline analysis.
+//
+// The render loop only evaluates the orbits and pushes a fixed-size sample into a lock-free queue;
+// quantization, compression and file I/O all happen on a dedicated writer thread. If the writer
+// falls behind, samples are dropped (and counted) rather than stalling the frame.
+//
+// File layout (all integers little-endian):
+//   header: "TRJ1", u32 version, u32 bodyCount, u32 columnCount, f32 interval, f32 quantum,
+//           then per body a u8 name length followed by the name bytes
+//   chunks: u32 rowCount, then per column a u32 byte length followed by the column data
+// Column 0 is the simulation time, followed by px, py, pz, vx, vy, vz for every body in BODIES order.
+// Each value is quantized to round(value / quantum), delta coded against the previous row of the
+// same column (the first row of a chunk against 0), zigzag mapped and stored as an LEB128 varint.
+const unsigned int TRAJECTORY_COMPONENTS = 6;
+const unsigned int TRAJECTORY_CHUNK_ROWS = 1024;
+
+struct TrajectorySample {
+    float time;
+    float values[BODY_COUNT * TRAJECTORY_COMPONENTS];
+};
+
+class TrajectoryWriter
+{
+public:
+    // interval is the sampling cadence in simulation days, quantum the precision values are stored with
+    TrajectoryWriter(const std::string& path, float interval, float quantum = 1.0e-4f)
+        : interval(interval), quantum(quantum), nextSample(0), dropped(0), running(true), queue(4096),
+          columns(1 + BODY_COUNT * TRAJECTORY_COMPONENTS), rows(0)
+    {
+        file.open(path.c_str(), std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            std::cout << "ERROR::TRAJECTORY::FILE_NOT_SUCCESFULLY_OPENED: " << path << std::endl;
+            running = false;
+            return;
+        }
+        writeHeader();
+        for (unsigned int i = 0; i < columns.size(); i++)
+            columns[i].reserve(TRAJECTORY_CHUNK_ROWS);
+        worker = std::thread(&TrajectoryWriter::run, this);
+    }
+
+    ~TrajectoryWriter()
+    {
+        running = false;
+        if (worker.joinable())
+            worker.join();
+        if (dropped > 0)
+            std::cout << "TRAJECTORY: dropped " << dropped << " samples" << std::endl;
+    }
+
+    bool isOpen() const
+    {
+        return worker.joinable();
+    }
+
+    // called once per simulation step; records one sample for every multiple of interval reached since the
+    // last call, evaluated at that exact time, so a long frame does not thin out the recording. An interval
+    // of 0 records every call.
+    void update(float simulationTime)
+    {
+        if (!isOpen())
+            return;
+        if (interval <= 0.0f)
+        {
+            record(simulationTime);
+            return;
+        }
+        for (; (float)(nextSample * (double)interval) <= simulationTime; nextSample++)
+            record((float)(nextSample * (double)interval));
+    }
+
+    unsigned long droppedSamples() const
+    {
+        return dropped;
+    }
+
+private:
+    float interval;
+    float quantum;
+    unsigned long long nextSample; // index of the next sample, at nextSample * interval
+    unsigned long dropped;
+    std::atomic<bool> running;
+    SpscQueue<TrajectorySample> queue;
+    std::thread worker;
+    std::ofstream file;
+
+    void record(float time)
+    {
+        TrajectorySample sample;
+        sample.time = time;
+        for (unsigned int i = 0; i < BODY_COUNT; i++)
+        {
+            glm::vec3 p = BODIES[i].position(time);
+            glm::vec3 v = BODIES[i].velocity(time);
+            float* out = &sample.values[i * TRAJECTORY_COMPONENTS];
+            out[0] = p.x; out[1] = p.y; out[2] = p.z;
+            out[3] = v.x; out[4] = v.y; out[5] = v.z;
+        }
+        if (!queue.tryPush(sample))
+            dropped++;
+    }
+
+    // writer thread state: quantized values of the current chunk, one vector per column
+    std::vector<std::vector<int64_t> > columns;
+    unsigned int rows;
+    std::vector<uint8_t> encoded;
+
+    void run()
+    {
+        Trace::setThreadName("trajectory writer");
+        TrajectorySample sample;
+        for (;;)
+        {
+            bool stopping = !running.load();
+            bool any = false;
+            while (queue.tryPop(sample))
+            {
+                append(sample);
+                any = true;
+            }
+            if (stopping)
+                break;
+            if (!any)
+                std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        flushChunk();
+        file.close();
+    }
+
+    void append(const TrajectorySample& sample)
+    {
+        columns[0].push_back(quantize(sample.time));
+        for (unsigned int i = 0; i < BODY_COUNT * TRAJECTORY_COMPONENTS; i++)
+            columns[i + 1].push_back(quantize(sample.values[i]));
+        if (++rows == TRAJECTORY_CHUNK_ROWS)
+            flushChunk();
+    }
+
+    int64_t quantize(float value) const
+    {
+        return (int64_t)llround((double)value / quantum);
+    }
+
+    void flushChunk()
+    {
+        if (rows == 0)
+            return;
+        TraceScope trace("trajectory chunk");
+        writeU32(rows);
+        for (unsigned int c = 0; c < columns.size(); c++)
+        {
+            encoded.clear();
+            int64_t previous = 0;
+            for (unsigned int r = 0; r < rows; r++)
+            {
+                int64_t delta = columns[c][r] - previous;
+                previous = columns[c][r];
+                // zigzag: small negative deltas become small unsigned values
+                uint64_t zigzag = ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63);
+                while (zigzag >= 0x80)
+                {
+                    encoded.push_back((uint8_t)(zigzag | 0x80));
+                    zigzag >>= 7;
+                }
+                encoded.push_back((uint8_t)zigzag);
+            }
+            writeU32((uint32_t)encoded.size());
+            file.write((const char*)encoded.data(), encoded.size());
+            columns[c].clear();
+        }
+        rows = 0;
+    }
+
+    void writeHeader()
+    {
+        file.write("TRJ1", 4);
+        writeU32(1);
+        writeU32(BODY_COUNT);
+        writeU32((uint32_t)columns.size());
+        file.write((const char*)&interval, sizeof(float));
+        file.write((const char*)&quantum, sizeof(float));
+        for (unsigned int i = 0; i < BODY_COUNT; i++)
+        {
+            std::string name = BODIES[i].name;
+            uint8_t length = (uint8_t)name.size();
+            file.write((const char*)&length, 1);
+            file.write(name.data(), length);
+        }
+    }
+
+    void writeU32(uint32_t value)
+    {
+        uint8_t bytes[4] = { (uint8_t)value, (uint8_t)(value >> 8), (uint8_t)(value >> 16), (uint8_t)(value >> 24) };
+        file.write((const char*)bytes, 4);
+    }
+};
+#endif
@@ -14,9 +14,13 @@
 #  define M_PI  3.14159265358979323846
 #endif
 
+//  Only the GL scalar types are needed; programs that load GL through glad
+//    already have them and must not include glew after it.
+#ifndef __glad_h_
 #  include <GL/glew.h>
 #  include <GL/freeglut.h>
 #  include <GL/freeglut_ext.h>
+#endif
 
 // Define a helpful macro for handling offsets into buffer objects
 #define BUFFER_OFFSET( offset )   ((GLvoid*) (offset))
@@ -339,7 +343,7 @@ struct vec4 {
 
     vec4( const vec4& v ) { x = v.x;  y = v.y;  z = v.z;  w = v.w; }
 
-    vec4( const vec3& v, const float s = 1.0 ) : w(w)
+    vec4( const vec3& v, const float s = 1.0 ) : w(s)
 	{ x = v.x;  y = v.y;  z = v.z; }
 
     vec4( const vec2& v, const float z, const float w ) : z(z), w(w)
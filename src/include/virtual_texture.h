@@ -0,0 +1,439 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include "gpu_memory.h"
+#include "shader_m.h"
+#include "texture_loader.h"
+#include "trace.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Software virtual texturing of one large image (the 8k sun) in a fixed amount of video memory.
+//
+// The image and its mip chain are cut into TILE_SIZE pages. Only the pages the camera actually sees live
+// on the GPU, in one page cache texture of a fixed size; a page table texture with one texel per page and
+// mip level tells the fragment shader where a page sits in the cache, or where its finest resident
+// ancestor sits while the page itself is not there yet. Every page carries PAGE_BORDER texels of its
+// neighbours so bilinear filtering does not bleed across pages.
+//
+// Feedback: the fragment shader marks every page it would like to sample in a request buffer. The buffer
+// has FRAMES regions like FrameAllocator; beginFrame() reads the region written FRAMES frames ago, pages in
+// at most PAGE_UPLOADS_PER_FRAME of the requested pages, coarse levels first, and evicts the pages that
+// have gone longest without a request. The coarsest level is one page and always resident, so the page
+// table never points nowhere.
+//
+// The image is decoded and its mip chain built on a thread of its own; until that is done the layer is
+// drawn from the texture array as before. The decoded pyramid stays in CPU memory and pages are cut from
+// it on demand.
+class VirtualTexture
+{
+public:
+    static const int TILE_SIZE = 128;                          // texels of the image per page
+    static const int PAGE_BORDER = 4;                          // texels of the neighbours around each page
+    static const int PAGE_SIZE = TILE_SIZE + 2 * PAGE_BORDER;  // texels per page in the cache
+    static const unsigned int FRAMES = 3;                      // request buffers in flight
+    static const unsigned int PAGE_UPLOADS_PER_FRAME = 16;
+    static const unsigned int REQUEST_BINDING = 3;             // shader storage binding of the requests
+
+    // statistics
+    unsigned long long pagesUploaded;
+    unsigned long long pagesEvicted;
+    unsigned long long cacheFull; // requests left waiting because every page in the cache was in use
+
+    // budgetBytes bounds the page cache; the image must have power of two sides of at least TILE_SIZE
+    VirtualTexture(const std::string& path, size_t budgetBytes)
+        : pagesUploaded(0), pagesEvicted(0), cacheFull(0), path(path), width(0), height(0), levels(0),
+          decoded(false), failed(false), resident(false), attachedLayer(-1), frame(0), frameNumber(0), tableDirty(false),
+          pageTableTexture(0), cacheTexture(0), requestBuffer(0), requests(NULL)
+    {
+        int components;
+        if (!stbi_info(path.c_str(), &width, &height, &components))
+        {
+            std::cout << "ERROR::VIRTUAL_TEXTURE::LOAD_FAILED: " << path << std::endl;
+            failed = true;
+            return;
+        }
+        if ((width & (width - 1)) != 0 || (height & (height - 1)) != 0 || width < TILE_SIZE || height < TILE_SIZE)
+        {
+            std::cout << "ERROR::VIRTUAL_TEXTURE::NOT_POWER_OF_TWO: " << path << " is " << width << "x" << height << std::endl;
+            failed = true;
+            return;
+        }
+
+        // pages of every level, finest first, in the order the shader indexes the request buffer
+        tilesX = width / TILE_SIZE;
+        tilesY = height / TILE_SIZE;
+        while ((std::max(tilesX, tilesY) >> levels) > 0)
+            levels++;
+        for (int level = 0; level < levels; level++)
+        {
+            levelOffsets.push_back(pages.size());
+            for (int y = 0; y < levelTilesY(level); y++)
+                for (int x = 0; x < levelTilesX(level); x++)
+                {
+                    Page page = { level, x, y, -1, 0 };
+                    pages.push_back(page);
+                }
+        }
+
+        // as many pages as fit the budget, at 4 bytes per texel as drivers store RGB8
+        cachePages = std::max((int)std::sqrt((double)budgetBytes / (PAGE_SIZE * PAGE_SIZE * 4)), 1);
+        cachePages = std::min(cachePages, 255);
+        slots.assign(cachePages * cachePages, -1);
+
+        glGenTextures(1, &cacheTexture);
+        glState().bindTexture(GL_TEXTURE_2D, cacheTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGB8, cachePages * PAGE_SIZE, cachePages * PAGE_SIZE);
+        gpuMemory().allocate(GpuMemory::TEXTURE, cacheTexture, GPU_MEMORY_TEXTURES, path + " (page cache)",
+                             GpuMemory::textureBytes(GL_RGB8, cachePages * PAGE_SIZE, cachePages * PAGE_SIZE, 1, 1));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+        // RGBA8 per page: cache page x and y, level of the page actually held, 255 once anything is
+        glGenTextures(1, &pageTableTexture);
+        glState().bindTexture(GL_TEXTURE_2D, pageTableTexture);
+        glTexStorage2D(GL_TEXTURE_2D, levels, GL_RGBA8, tilesX, tilesY);
+        gpuMemory().allocate(GpuMemory::TEXTURE, pageTableTexture, GPU_MEMORY_TEXTURES, path + " (page table)",
+                             GpuMemory::textureBytes(GL_RGBA8, tilesX, tilesY, 1, levels));
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        pageTable.resize(pages.size() * 4, 0);
+        uploadPageTable();
+
+        GLint alignment;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        regionSize = (pages.size() * sizeof(GLuint) + alignment - 1) / alignment * alignment;
+        GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &requestBuffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, requestBuffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, regionSize * FRAMES, NULL, flags);
+        gpuMemory().allocate(GpuMemory::BUFFER, requestBuffer, GPU_MEMORY_STREAMING, path + " (page requests)", regionSize * FRAMES);
+        requests = static_cast<char*>(glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, regionSize * FRAMES, flags));
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        if (!requests)
+        {
+            std::cout << "ERROR::VIRTUAL_TEXTURE::MAP_FAILED" << std::endl;
+            failed = true;
+            return;
+        }
+        std::memset(requests, 0, regionSize * FRAMES);
+        for (unsigned int i = 0; i < FRAMES; i++)
+            fences[i] = 0;
+
+        decoder = std::thread(&VirtualTexture::decode, this);
+    }
+
+    ~VirtualTexture()
+    {
+        if (decoder.joinable())
+            decoder.join();
+        for (unsigned int i = 0; i < FRAMES && requests; i++)
+            if (fences[i])
+                glDeleteSync(fences[i]);
+        if (requestBuffer)
+        {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, requestBuffer);
+            if (requests)
+                glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            gpuMemory().release(GpuMemory::BUFFER, requestBuffer);
+            glDeleteBuffers(1, &requestBuffer);
+        }
+        gpuMemory().release(GpuMemory::TEXTURE, cacheTexture);
+        gpuMemory().release(GpuMemory::TEXTURE, pageTableTexture);
+        glDeleteTextures(1, &cacheTexture);
+        glDeleteTextures(1, &pageTableTexture);
+    }
+
+    // the layer of the texture array this replaces, and the program that samples it (sphereFrag.frag)
+    void attach(const Shader& shader, int layer)
+    {
+        attachedLayer = layer;
+        virtualLayer = shader.uniform<int>("virtualLayer");
+        shader.uniform<glm::vec2>("virtualSize").set(glm::vec2((float)width, (float)height));
+        shader.uniform<int>("virtualLevels").set(levels);
+        shader.uniform<glm::vec2>("pageTiles").set(glm::vec2((float)tilesX, (float)tilesY));
+        shader.uniform<float>("cacheSize").set((float)(cachePages * PAGE_SIZE));
+        virtualLayer.set(-1);
+        if (resident)
+            virtualLayer.set(attachedLayer);
+    }
+
+    // decoded, and the coarsest page is in the cache
+    bool ready() const
+    {
+        return resident;
+    }
+
+    // reads the requests of FRAMES frames ago and pages in what they asked for; call once per frame before drawing
+    void beginFrame()
+    {
+        if (failed)
+            return;
+        TraceScope trace("virtual texture");
+        frame = (frame + 1) % FRAMES;
+        frameNumber++;
+        if (fences[frame])
+        {
+            GLenum status = glClientWaitSync(fences[frame], 0, 0);
+            while (status == GL_TIMEOUT_EXPIRED)
+                status = glClientWaitSync(fences[frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            glDeleteSync(fences[frame]);
+            fences[frame] = 0;
+            readRequests();
+        }
+        std::memset(requests + frame * regionSize, 0, pages.size() * sizeof(GLuint));
+
+        if (!resident)
+        {
+            if (!decoded.load())
+                return;
+            decoder.join();
+            if (pyramid.empty())
+            {
+                failed = true;
+                return;
+            }
+            // the coarsest level is one page and never leaves
+            int root = pages.size() - 1;
+            pageIn(root, 0);
+            pages[root].lastUsed = ~0ull;
+            resident = true;
+            virtualLayer.set(attachedLayer);
+        }
+
+        unsigned int uploads = 0;
+        for (unsigned int i = 0; i < wanted.size() && uploads < PAGE_UPLOADS_PER_FRAME; i++)
+        {
+            int page = wanted[i];
+            if (pages[page].slot >= 0)
+                continue;
+            int slot = evictable();
+            if (slot < 0)
+            {
+                cacheFull += wanted.size() - i;
+                break;
+            }
+            pageIn(page, slot);
+            uploads++;
+        }
+        wanted.clear();
+        if (tableDirty)
+            uploadPageTable();
+    }
+
+    // the page table, the cache and this frame's request buffer, for the draws that sample them
+    void bind()
+    {
+        if (failed)
+            return;
+        glState().activeTexture(GL_TEXTURE0 + PAGE_TABLE_UNIT);
+        glState().bindTexture(GL_TEXTURE_2D, pageTableTexture);
+        glState().activeTexture(GL_TEXTURE0 + PAGE_CACHE_UNIT);
+        glState().bindTexture(GL_TEXTURE_2D, cacheTexture);
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, REQUEST_BINDING, requestBuffer, frame * regionSize, regionSize);
+    }
+
+    // fences this frame's requests; call after the draws that sample the texture
+    void endFrame()
+    {
+        if (failed)
+            return;
+        glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+        fences[frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    unsigned int residentPages() const
+    {
+        unsigned int count = 0;
+        for (unsigned int i = 0; i < slots.size(); i++)
+            count += slots[i] >= 0;
+        return count;
+    }
+
+    // video memory: the page cache, the page table and the request buffers
+    size_t residentBytes() const
+    {
+        if (!cacheTexture)
+            return 0;
+        return (size_t)cachePages * PAGE_SIZE * cachePages * PAGE_SIZE * 4 + pages.size() * 4 + regionSize * FRAMES;
+    }
+
+    // bytes the whole image would take as one mipmapped RGB8 texture
+    size_t fullBytes() const
+    {
+        return (size_t)width * height * 4 * 4 / 3;
+    }
+
+private:
+    static const int PAGE_TABLE_UNIT = 1; // layout bindings of sphereFrag.frag
+    static const int PAGE_CACHE_UNIT = 2;
+
+    struct Page {
+        int level;
+        int x, y;
+        int slot;                     // cache page holding it, -1 if not resident
+        unsigned long long lastUsed;  // frame of the last request
+    };
+
+    std::string path;
+    int width, height;
+    int tilesX, tilesY; // pages of level 0
+    int levels;
+    std::vector<Page> pages;
+    std::vector<unsigned int> levelOffsets;
+    std::vector<int> slots; // page in each cache page, -1 if free
+    int cachePages;         // cache pages per side
+    std::vector<int> wanted;
+
+    std::thread decoder;
+    std::vector<std::vector<unsigned char> > pyramid; // RGB, level 0 first
+    std::atomic<bool> decoded;
+    bool failed;
+    bool resident;
+    int attachedLayer;
+    Uniform<int> virtualLayer;
+
+    unsigned int frame;
+    unsigned long long frameNumber;
+    std::vector<unsigned char> pageTable;
+    bool tableDirty;
+
+    unsigned int pageTableTexture, cacheTexture;
+    unsigned int requestBuffer;
+    char* requests;
+    GLsizeiptr regionSize;
+    GLsync fences[FRAMES];
+
+    int levelTilesX(int level) const { return std::max(tilesX >> level, 1); }
+    int levelTilesY(int level) const { return std::max(tilesY >> level, 1); }
+
+    // decoder thread: the image and its box filtered mip chain down to the single page of the last level
+    void decode()
+    {
+        TraceScope trace("virtual texture decode", Trace::intern(path.c_str()));
+        int w, h, components;
+        unsigned char* data = stbi_load(path.c_str(), &w, &h, &components, 3);
+        if (data)
+        {
+            pyramid.resize(levels);
+            pyramid[0].assign(data, data + (size_t)w * h * 3);
+            stbi_image_free(data);
+            for (int level = 1; level < levels; level++)
+            {
+                int levelWidth = std::max(width >> level, 1), levelHeight = std::max(height >> level, 1);
+                pyramid[level].resize((size_t)levelWidth * levelHeight * 3);
+                resampleImage(&pyramid[level - 1][0], std::max(width >> (level - 1), 1), std::max(height >> (level - 1), 1),
+                              &pyramid[level][0], levelWidth, levelHeight, 3);
+            }
+        }
+        else
+            std::cout << "ERROR::VIRTUAL_TEXTURE::LOAD_FAILED: " << path << std::endl;
+        decoded.store(true);
+    }
+
+    // marks the requested pages used, and queues the missing ones coarsest first
+    void readRequests()
+    {
+        const GLuint* requested = reinterpret_cast<const GLuint*>(requests + frame * regionSize);
+        for (unsigned int i = 0; i + 1 < pages.size(); i++)
+        {
+            if (!requested[i])
+                continue;
+            pages[i].lastUsed = frameNumber;
+            if (pages[i].slot < 0)
+                wanted.push_back(i);
+        }
+        // a blurry page everywhere beats a sharp one here and nothing there
+        std::stable_sort(wanted.begin(), wanted.end(), [this](int a, int b) { return pages[a].level > pages[b].level; });
+    }
+
+    // a free cache page, or the least recently requested one unless that was requested this frame
+    int evictable()
+    {
+        int best = -1;
+        for (unsigned int slot = 0; slot < slots.size(); slot++)
+        {
+            if (slots[slot] < 0)
+                return slot;
+            if (best < 0 || pages[slots[slot]].lastUsed < pages[slots[best]].lastUsed)
+                best = slot;
+        }
+        if (best < 0 || pages[slots[best]].lastUsed >= frameNumber)
+            return -1;
+        pages[slots[best]].slot = -1;
+        slots[best] = -1;
+        pagesEvicted++;
+        return best;
+    }
+
+    // cuts the page and its border out of the pyramid, wrapping around in u like the sphere does
+    void pageIn(int index, int slot)
+    {
+        Page& page = pages[index];
+        int levelWidth = std::max(width >> page.level, 1), levelHeight = std::max(height >> page.level, 1);
+        const unsigned char* source = &pyramid[page.level][0];
+        std::vector<unsigned char> texels(PAGE_SIZE * PAGE_SIZE * 3);
+        for (int y = 0; y < PAGE_SIZE; y++)
+        {
+            int sourceY = std::min(std::max(page.y * TILE_SIZE + y - PAGE_BORDER, 0), levelHeight - 1);
+            for (int x = 0; x < PAGE_SIZE; x++)
+            {
+                int sourceX = ((page.x * TILE_SIZE + x - PAGE_BORDER) % levelWidth + levelWidth) % levelWidth;
+                std::memcpy(&texels[(y * PAGE_SIZE + x) * 3], source + ((size_t)sourceY * levelWidth + sourceX) * 3, 3);
+            }
+        }
+        glState().bindTexture(GL_TEXTURE_2D, cacheTexture);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % cachePages) * PAGE_SIZE, (slot / cachePages) * PAGE_SIZE, PAGE_SIZE, PAGE_SIZE,
+                        GL_RGB, GL_UNSIGNED_BYTE, &texels[0]);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        gpuMemory().uploaded(texels.size());
+        page.slot = slot;
+        slots[slot] = index;
+        pagesUploaded++;
+        tableDirty = true;
+    }
+
+    // every page points at itself if resident, else at what its parent points at
+    void uploadPageTable()
+    {
+        for (int level = levels - 1; level >= 0; level--)
+            for (int y = 0; y < levelTilesY(level); y++)
+                for (int x = 0; x < levelTilesX(level); x++)
+                {
+                    unsigned int index = levelOffsets[level] + y * levelTilesX(level) + x;
+                    unsigned char* entry = &pageTable[index * 4];
+                    const Page& page = pages[index];
+                    if (page.slot >= 0)
+                    {
+                        entry[0] = (unsigned char)(page.slot % cachePages);
+                        entry[1] = (unsigned char)(page.slot / cachePages);
+                        entry[2] = (unsigned char)level;
+                        entry[3] = 255;
+                    }
+                    else if (level + 1 < levels)
+                        std::memcpy(entry, &pageTable[(levelOffsets[level + 1] + (y / 2) * levelTilesX(level + 1) + x / 2) * 4], 4);
+                    else
+                        std::memset(entry, 0, 4);
+                }
+        glState().bindTexture(GL_TEXTURE_2D, pageTableTexture);
+        for (int level = 0; level < levels; level++)
+            glTexSubImage2D(GL_TEXTURE_2D, level, 0, 0, levelTilesX(level), levelTilesY(level), GL_RGBA, GL_UNSIGNED_BYTE,
+                            &pageTable[levelOffsets[level] * 4]);
+        gpuMemory().uploaded(pageTable.size());
+        tableDirty = false;
+    }
+};
+#endif
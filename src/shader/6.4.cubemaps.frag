@@ -1,16 +1,24 @@
-#version 460 core
+#version 430 core
 out vec4 FragColor;
 
 in vec3 Normal;
 in vec3 Position;
 
-uniform vec3 cameraPos;
+// per-frame constants, see FrameUniforms in frame_uniforms.h
+layout (std140, binding = 0) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 cameraPos;
+    float time;
+    float simulationTime;
+};
 uniform samplerCube skybox;
 
 void main()
 {             
     float ratio = 1.00 / 1.52;
-    vec3 I = normalize(Position - cameraPos);
+    vec3 I = normalize(Position - cameraPos.xyz);
     vec3 R = refract(I, normalize(Normal), ratio);
     FragColor = vec4(texture(skybox, R).rgb, 1.0);
 }  
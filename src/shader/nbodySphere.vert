@@ -0,0 +1,34 @@
+#version 430 core
+
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec2 aTexCoord;
+
+// body positions written by the N-body backend, xyz = position, w = mass
+layout (std430, binding = 0) readonly buffer Positions { vec4 positions[]; };
+
+out vec2 TexCoord;
+flat out int Layer;
+out vec4 Tint;
+
+// per-frame constants, see FrameUniforms in frame_uniforms.h
+layout (std140, binding = 0) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 cameraPos;
+    float time;
+    float simulationTime;
+};
+
+uniform int firstBody;
+uniform float bodyScale;
+uniform int layer;
+
+void main()
+{
+    vec3 center = positions[firstBody + gl_InstanceID].xyz;
+    TexCoord = aTexCoord;
+    Layer = layer;
+    Tint = vec4(1.0);
+    gl_Position = viewProj * vec4(center + aPos * bodyScale, 1.0);
+}
@@ -1,12 +1,72 @@
-#version 460 core
+#version 430 core
 
 out vec4 FragColor;
 
 in vec2 TexCoord;
+flat in int Layer;
+in vec4 Tint;
 
-uniform sampler2D texture1;
+uniform sampler2DArray planetTextures;
+
+// one layer can be drawn from a virtual texture instead, see VirtualTexture in virtual_texture.h
+uniform int virtualLayer = -1;  // -1 while there is none or it is not resident yet
+// units fixed here, a sampler2D left on unit 0 would clash with the array
+layout (binding = 1) uniform sampler2D pageTable; // per page and level: cache page x and y, level of the page held there
+layout (binding = 2) uniform sampler2D pageCache;
+uniform vec2 virtualSize;       // texels of level 0
+uniform int virtualLevels;
+uniform vec2 pageTiles;         // pages of level 0
+uniform float cacheSize;        // texels per side of the page cache
+
+// every page sampled this frame, read back by VirtualTexture::beginFrame
+layout (std430, binding = 3) writeonly buffer PageRequests { uint pageRequests[]; };
+
+// VirtualTexture::TILE_SIZE and PAGE_BORDER
+const int TILE_SIZE = 128;
+const int PAGE_BORDER = 4;
+const int PAGE_SIZE = TILE_SIZE + 2 * PAGE_BORDER;
+
+vec4 sampleVirtual(vec2 texel, float lod)
+{
+    int level = clamp(int(lod), 0, virtualLevels - 1);
+    ivec2 baseTiles = ivec2(pageTiles);
+    ivec2 tiles = max(baseTiles >> level, ivec2(1));
+    ivec2 tile = clamp(ivec2(texel / float(TILE_SIZE << level)), ivec2(0), tiles - 1);
+
+    // requests are indexed finest level first, like VirtualTexture::pages
+    int index = tile.y * tiles.x + tile.x;
+    for (int l = 0; l < level; l++)
+    {
+        ivec2 levelTiles = max(baseTiles >> l, ivec2(1));
+        index += levelTiles.x * levelTiles.y;
+    }
+    pageRequests[index] = 1u;
+
+    // the page itself, or the finest resident page above it
+    vec4 entry = texelFetch(pageTable, tile, level) * 255.0;
+    if (entry.a < 0.5)
+        return texture(planetTextures, vec3(TexCoord, Layer));
+    int held = int(entry.b + 0.5);
+    vec2 heldTexel = texel / float(1 << held);
+    ivec2 heldTiles = max(baseTiles >> held, ivec2(1));
+    ivec2 heldTile = clamp(ivec2(heldTexel / float(TILE_SIZE)), ivec2(0), heldTiles - 1);
+    vec2 inPage = heldTexel - vec2(heldTile * TILE_SIZE);
+    vec2 cacheTexel = floor(entry.rg + 0.5) * float(PAGE_SIZE) + float(PAGE_BORDER) + inPage;
+    return textureLod(pageCache, cacheTexel / cacheSize, 0.0);
+}
 
 void main()
 {
-    FragColor = texture(texture1, TexCoord);
+    // mip level of the virtual texture from the screen-space footprint, taken before any branch
+    vec2 texel = TexCoord * virtualSize;
+    vec2 dx = dFdx(texel), dy = dFdy(texel);
+    float lod = max(0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)), 0.0);
+
+    // a negative layer marks an untextured material
+    vec4 color = vec4(1.0);
+    if (Layer >= 0 && Layer == virtualLayer)
+        color = sampleVirtual(texel, lod);
+    else if (Layer >= 0)
+        color = texture(planetTextures, vec3(TexCoord, Layer));
+    FragColor = Tint * color;
 }
@@ -1,16 +1,44 @@
-#version 460 core
+#version 430 core
 
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in vec2 aTexCoord;
+// per instance: baseInstance + gl_InstanceID, the index of this object in objects[]
+layout (location = 5) in uint aObject;
+
+struct ObjectData {
+    mat4 model;
+    uint material;
+};
+
+struct MaterialData {
+    vec4 color;
+    int layer;
+};
+
+// written by IndirectRenderer::flush
+layout (std430, binding = 1) readonly buffer Objects { ObjectData objects[]; };
+layout (std430, binding = 2) readonly buffer Materials { MaterialData materials[]; };
 
 out vec2 TexCoord;
+flat out int Layer;
+out vec4 Tint;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per-frame constants, see FrameUniforms in frame_uniforms.h
+layout (std140, binding = 0) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 cameraPos;
+    float time;
+    float simulationTime;
+};
 
 void main()
 {
+    ObjectData object = objects[aObject];
+    MaterialData material = materials[object.material];
     TexCoord = aTexCoord;
-    gl_Position = projection * view * model * vec4(aPos, 1.0);
+    Layer = material.layer;
+    Tint = material.color;
+    gl_Position = viewProj * object.model * vec4(aPos, 1.0);
 }
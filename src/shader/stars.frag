@@ -0,0 +1,14 @@
+#version 430 core
+
+out vec4 FragColor;
+
+in vec3 Color;
+
+void main()
+{
+    // round sprite with a soft edge
+    float d = length(gl_PointCoord - vec2(0.5)) * 2.0;
+    if (d > 1.0)
+        discard;
+    FragColor = vec4(Color * (1.0 - d * d), 1.0);
+}
@@ -0,0 +1,28 @@
+#version 430 core
+
+layout (location = 0) in vec3 aDirection;
+layout (location = 1) in float aMagnitude;
+layout (location = 2) in vec4 aColor;
+
+// per-frame constants, see FrameUniforms in frame_uniforms.h
+layout (std140, binding = 0) uniform Frame {
+    mat4 view;
+    mat4 projection;
+    mat4 viewProj;
+    vec4 cameraPos;
+    float time;
+    float simulationTime;
+};
+
+out vec3 Color;
+
+void main()
+{
+    // stars are infinitely far away: no view translation, depth at the far plane like the skybox
+    vec4 pos = projection * mat4(mat3(view)) * vec4(aDirection, 1.0);
+    gl_Position = pos.xyww;
+    // flux relative to a magnitude 1 star; faint stars shrink to one pixel and fade, bright ones grow
+    float flux = pow(10.0, -0.4 * (aMagnitude - 1.0));
+    gl_PointSize = clamp(1.0 + 2.5 * sqrt(flux), 1.0, 6.0);
+    Color = aColor.rgb * clamp(0.15 + 4.0 * flux, 0.15, 1.0);
+}
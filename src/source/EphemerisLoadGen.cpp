@@ -0,0 +1,138 @@
+// Load generator for the ephemeris server (SolarSystem --serve <socket>).
+//
+// usage: EphemerisLoadGen <socket> [connections] [times per request] [seconds] [requests in flight]
+//
+// Every connection runs on its own thread and keeps a fixed number of pipelined requests in flight,
+// so the server sees many concurrent requests per wake-up and can batch them.
+#include "ephemeris_server.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+std::atomic<unsigned long long> totalQueries(0);
+std::atomic<unsigned long long> totalErrors(0);
+
+bool writeAll(int fd, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool readAll(int fd, char* data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = read(fd, data, size);
+        if (n <= 0)
+            return false;
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+void runConnection(const char* socketPath, unsigned int timesPerRequest, unsigned int inFlight, double seconds, unsigned int seed)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socketPath, sizeof(address.sun_path) - 1);
+    if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) < 0)
+    {
+        std::cout << "ERROR::LOADGEN::CONNECT_FAILED: " << strerror(errno) << std::endl;
+        totalErrors++;
+        return;
+    }
+
+    // one request buffer, reused with a different body and id every time
+    std::vector<char> request(sizeof(EphemerisRequest) + timesPerRequest * sizeof(float));
+    float* times = (float*)&request[sizeof(EphemerisRequest)];
+    for (unsigned int i = 0; i < timesPerRequest; i++)
+        times[i] = (float)((seed * 7919 + i * 13) % 100000) * 0.01f;
+    std::vector<char> response(sizeof(EphemerisResponse) + timesPerRequest * 3 * sizeof(float));
+
+    uint32_t nextId = 0;
+    uint32_t expectedId = 0;
+    unsigned long long queries = 0;
+    std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::microseconds((long long)(seconds * 1.0e6));
+
+    bool ok = true;
+    while (ok)
+    {
+        bool stopping = std::chrono::steady_clock::now() >= end;
+        // top the pipeline up
+        while (!stopping && nextId - expectedId < inFlight)
+        {
+            EphemerisRequest header;
+            header.id = nextId++;
+            header.body = header.id % BODY_COUNT;
+            header.count = timesPerRequest;
+            memcpy(&request[0], &header, sizeof(header));
+            if (!writeAll(fd, &request[0], request.size()))
+            {
+                ok = false;
+                break;
+            }
+        }
+        if (expectedId == nextId)
+            break;
+        // drain one response
+        EphemerisResponse header;
+        if (!ok || !readAll(fd, (char*)&header, sizeof(header)) || header.id != expectedId || header.status != EPHEMERIS_OK ||
+            !readAll(fd, &response[0], header.count * 3 * sizeof(float)))
+        {
+            totalErrors++;
+            break;
+        }
+        queries += header.count;
+        expectedId++;
+    }
+    close(fd);
+    totalQueries += queries;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        std::cout << "usage: EphemerisLoadGen <socket> [connections] [times per request] [seconds] [requests in flight]" << std::endl;
+        return 1;
+    }
+    const char* socketPath = argv[1];
+    unsigned int connections = argc > 2 ? atoi(argv[2]) : 8;
+    unsigned int timesPerRequest = argc > 3 ? atoi(argv[3]) : 256;
+    double seconds = argc > 4 ? atof(argv[4]) : 5.0;
+    unsigned int inFlight = argc > 5 ? atoi(argv[5]) : 8;
+    if (timesPerRequest == 0 || timesPerRequest > EPHEMERIS_MAX_TIMES)
+        timesPerRequest = 256;
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < connections; i++)
+        threads.push_back(std::thread(runConnection, socketPath, timesPerRequest, inFlight, seconds, i + 1));
+    for (unsigned int i = 0; i < threads.size(); i++)
+        threads[i].join();
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    // machine-readable single line summary
+    std::cout << "connections=" << connections
+              << " times_per_request=" << timesPerRequest
+              << " in_flight=" << inFlight
+              << " seconds=" << elapsed
+              << " queries=" << totalQueries.load()
+              << " queries_per_second=" << (unsigned long long)(totalQueries.load() / elapsed)
+              << " errors=" << totalErrors.load() << std::endl;
+    return totalErrors.load() == 0 ? 0 : 1;
+}
@@ -0,0 +1,483 @@
+// Microbenchmarks of the CPU-side hot spots of SolarSystem.
+//
+// usage: MicroBenchmarks [name filter]
+//
+// Covers sphere generation at several resolutions, image decode, resampling and block compression,
+// loadTexture/loadCubemap/loadTextureArray against TextureStreamer and against the .ktx2 files of TextureBaker
+// (when baked), TextureResidency::update on a fly-by past the planets under half the video memory their
+// textures need, Model::processMesh on synthetic meshes, Model::Draw through the RenderQueue, the Angel
+// mat.h/vec.h operators against glm, and the per-body matrices of a frame. Each benchmark is warmed up,
+// then timed in SAMPLES samples of as many iterations as fill SAMPLE_SECONDS; the median time per iteration
+// and the median absolute deviation of the samples (as a percentage) are printed, which stay put from run
+// to run far better than a mean.
+//
+// Benchmarks that create GL objects run in a headless EGL context and are skipped in builds without EGL.
+// Run from bin/bin like SolarSystem, the texture paths are relative to it.
+#include <glad/glad.h>
+#ifdef HAVE_EGL
+#include "headless_context.h"
+#include "offscreen_target.h"
+#endif
+
+#include "model.h"
+#include "sphere.h"
+#include "texture_loader.h"
+#include "texture_streamer.h"
+#include "texture_residency.h"
+#include "bc_encoder.h"
+#include "frame_uniforms.h"
+#include "filesystem.h"
+#include "orbit.h"
+#include "mat.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock Clock;
+
+const unsigned int SAMPLES = 15;
+const double SAMPLE_SECONDS = 0.02;
+const double WARMUP_SECONDS = 0.1;
+
+static double secondsSince(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// keeps the compiler from dropping a computation whose result is otherwise unused
+template<typename T>
+inline void keep(const T& value)
+{
+#if defined(__GNUC__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static const void* volatile sink;
+    sink = &value;
+#endif
+}
+
+static const char* filter = NULL;
+
+template<typename Function>
+void benchmark(const std::string& name, Function function)
+{
+    if (filter && name.find(filter) == std::string::npos)
+        return;
+
+    Clock::time_point start = Clock::now();
+    while (secondsSince(start) < WARMUP_SECONDS)
+        function();
+
+    // double the iteration count until one sample lasts long enough to time reliably
+    unsigned long long iterations = 1;
+    for (;;)
+    {
+        start = Clock::now();
+        for (unsigned long long i = 0; i < iterations; i++)
+            function();
+        if (secondsSince(start) >= SAMPLE_SECONDS)
+            break;
+        iterations *= 2;
+    }
+
+    std::vector<double> samples(SAMPLES);
+    for (unsigned int s = 0; s < SAMPLES; s++)
+    {
+        start = Clock::now();
+        for (unsigned long long i = 0; i < iterations; i++)
+            function();
+        samples[s] = secondsSince(start) * 1.0e9 / iterations;
+    }
+    std::sort(samples.begin(), samples.end());
+    double median = samples[SAMPLES / 2];
+    std::vector<double> deviations(SAMPLES);
+    for (unsigned int s = 0; s < SAMPLES; s++)
+        deviations[s] = std::fabs(samples[s] - median);
+    std::sort(deviations.begin(), deviations.end());
+    double spread = 100.0 * deviations[SAMPLES / 2] / median;
+
+    if (median >= 1.0e6)
+        std::printf("%-44s %12.3f ms  +-%5.2f%%  (%u x %llu)\n", name.c_str(), median * 1.0e-6, spread, SAMPLES, iterations);
+    else
+        std::printf("%-44s %12.1f ns  +-%5.2f%%  (%u x %llu)\n", name.c_str(), median, spread, SAMPLES, iterations);
+    std::fflush(stdout);
+}
+
+// Model::processMesh is private, a friend builds the synthetic meshes and calls it
+class ModelBenchmark
+{
+public:
+    // a side x side vertex grid on the unit sphere's front half with normals, uvs, tangents and bitangents,
+    // two triangles per cell, and one material without textures
+    static aiScene* createScene(unsigned int side)
+    {
+        aiMesh* mesh = new aiMesh();
+        mesh->mNumVertices = side * side;
+        mesh->mVertices = new aiVector3D[mesh->mNumVertices];
+        mesh->mNormals = new aiVector3D[mesh->mNumVertices];
+        mesh->mTangents = new aiVector3D[mesh->mNumVertices];
+        mesh->mBitangents = new aiVector3D[mesh->mNumVertices];
+        mesh->mTextureCoords[0] = new aiVector3D[mesh->mNumVertices];
+        mesh->mNumUVComponents[0] = 2;
+        for (unsigned int y = 0; y < side; y++)
+        {
+            for (unsigned int x = 0; x < side; x++)
+            {
+                unsigned int i = y * side + x;
+                float u = (float)x / (side - 1), v = (float)y / (side - 1);
+                float theta = u * 3.14159265f, phi = v * 3.14159265f;
+                aiVector3D position(std::cos(theta) * std::sin(phi), std::cos(phi), std::sin(theta) * std::sin(phi));
+                mesh->mVertices[i] = position;
+                mesh->mNormals[i] = position;
+                mesh->mTangents[i] = aiVector3D(-std::sin(theta), 0.0f, std::cos(theta));
+                mesh->mBitangents[i] = aiVector3D(std::cos(theta) * std::cos(phi), -std::sin(phi), std::sin(theta) * std::cos(phi));
+                mesh->mTextureCoords[0][i] = aiVector3D(u, v, 0.0f);
+            }
+        }
+        mesh->mNumFaces = 2 * (side - 1) * (side - 1);
+        mesh->mFaces = new aiFace[mesh->mNumFaces];
+        unsigned int face = 0;
+        for (unsigned int y = 0; y + 1 < side; y++)
+        {
+            for (unsigned int x = 0; x + 1 < side; x++)
+            {
+                unsigned int corners[2][3] = {
+                    { y * side + x, (y + 1) * side + x, y * side + x + 1 },
+                    { y * side + x + 1, (y + 1) * side + x, (y + 1) * side + x + 1 }
+                };
+                for (unsigned int t = 0; t < 2; t++, face++)
+                {
+                    mesh->mFaces[face].mNumIndices = 3;
+                    mesh->mFaces[face].mIndices = new unsigned int[3];
+                    std::memcpy(mesh->mFaces[face].mIndices, corners[t], sizeof(corners[t]));
+                }
+            }
+        }
+        mesh->mMaterialIndex = 0;
+
+        aiScene* scene = new aiScene();
+        scene->mNumMeshes = 1;
+        scene->mMeshes = new aiMesh*[1];
+        scene->mMeshes[0] = mesh;
+        scene->mNumMaterials = 1;
+        scene->mMaterials = new aiMaterial*[1];
+        scene->mMaterials[0] = new aiMaterial();
+        return scene;
+    }
+
+    static Mesh processMesh(aiScene* scene)
+    {
+        Model model;
+        return model.processMesh(scene->mMeshes[0], scene);
+    }
+
+    // a model of count copies of the scene's mesh
+    static Model createModel(aiScene* scene, unsigned int count)
+    {
+        Model model;
+        for (unsigned int i = 0; i < count; i++)
+            model.meshes.push_back(model.processMesh(scene->mMeshes[0], scene));
+        return model;
+    }
+};
+
+#ifdef HAVE_EGL
+// processMesh and createSphere create buffers every call; free them so a long run does not grow
+static void deleteVertexArray(unsigned int vertexArray)
+{
+    GLint arrayBuffer = 0, elementBuffer = 0;
+    glBindVertexArray(vertexArray);
+    glGetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_BUFFER_BINDING, &arrayBuffer);
+    glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elementBuffer);
+    glBindVertexArray(0);
+    GLuint buffers[2] = { (GLuint)arrayBuffer, (GLuint)elementBuffer };
+    gpuMemory().release(GpuMemory::BUFFER, buffers[0]);
+    gpuMemory().release(GpuMemory::BUFFER, buffers[1]);
+    glDeleteBuffers(2, buffers);
+    glDeleteVertexArrays(1, &vertexArray);
+    glState().invalidate(); // the deleted names are handed out again
+}
+
+static void deleteTexture(unsigned int texture)
+{
+    gpuMemory().release(GpuMemory::TEXTURE, texture);
+    glDeleteTextures(1, &texture);
+    glState().invalidate();
+}
+#endif
+
+int main(int argc, char** argv)
+{
+    if (argc > 1)
+        filter = argv[1];
+
+    // geometry
+    // --------
+    const unsigned int sphereSegments[] = { 8, 16, 64, 256 };
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        unsigned int segments = sphereSegments[i];
+        std::vector<Vertex> vertices;
+        std::vector<unsigned int> indices;
+        benchmark("buildSphere/" + std::to_string(segments), [&]() {
+            vertices.clear();
+            indices.clear();
+            buildSphere(segments, vertices, indices);
+            keep(vertices[0]);
+        });
+    }
+
+    // image decode and resampling
+    // ---------------------------
+    std::string earthPath = BODIES[EARTH].texture;
+    std::string sunPath = "../../src/resources/textures/planets/8k_sun.jpg";
+    std::vector<std::string> faces
+    {
+        FileSystem::getPath("resources/textures/skybox/blue/bkg1_right.png"),
+        FileSystem::getPath("resources/textures/skybox/blue/bkg1_left.png"),
+        FileSystem::getPath("resources/textures/skybox/blue/bkg1_top.png"),
+        FileSystem::getPath("resources/textures/skybox/blue/bkg1_bot.png"),
+        FileSystem::getPath("resources/textures/skybox/blue/bkg1_front.png"),
+        FileSystem::getPath("resources/textures/skybox/blue/bkg1_back.png"),
+    };
+    const std::string decodePaths[] = { earthPath, sunPath, faces[0] };
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        const std::string& path = decodePaths[i];
+        int width, height, channels;
+        if (!stbi_info(path.c_str(), &width, &height, &channels))
+        {
+            std::printf("%-44s skipped, cannot read %s\n", "stbi_load", path.c_str());
+            continue;
+        }
+        benchmark("stbi_load/" + path.substr(path.find_last_of('/') + 1), [&]() {
+            unsigned char* data = stbi_load(path.c_str(), &width, &height, &channels, 0);
+            keep(data);
+            stbi_image_free(data);
+        });
+    }
+    {
+        int width, height, channels;
+        unsigned char* earth = stbi_load(earthPath.c_str(), &width, &height, &channels, 3);
+        if (earth)
+        {
+            std::vector<unsigned char> half((width / 2) * (height / 2) * 3), twice(width * 2 * height * 2 * 3);
+            benchmark("resampleImage/down_2x", [&]() {
+                resampleImage(earth, width, height, &half[0], width / 2, height / 2, 3);
+                keep(half[0]);
+            });
+            benchmark("resampleImage/up_2x", [&]() {
+                resampleImage(earth, width, height, &twice[0], width * 2, height * 2, 3);
+                keep(twice[0]);
+            });
+        }
+        stbi_image_free(earth);
+    }
+    {
+        // block compression of a 256x256 tile as TextureBaker does it for every mip level
+        int width, height, channels;
+        unsigned char* earth = stbi_load(earthPath.c_str(), &width, &height, &channels, 4);
+        if (earth && width >= 256 && height >= 256)
+        {
+            const int TILE = 256;
+            std::vector<unsigned char> tile(TILE * TILE * 4), blocks;
+            for (int y = 0; y < TILE; y++)
+                memcpy(&tile[y * TILE * 4], earth + ((size_t)y * width) * 4, TILE * 4);
+            const BlockFormat formats[] = { BLOCK_BC1, BLOCK_BC3, BLOCK_BC7 };
+            const char* const names[] = { "bc1", "bc3", "bc7" };
+            for (unsigned int i = 0; i < 3; i++)
+                benchmark(std::string("compressImage/") + names[i] + "_256", [&]() {
+                    compressImage(formats[i], &tile[0], TILE, TILE, blocks);
+                    keep(blocks[0]);
+                });
+        }
+        stbi_image_free(earth);
+    }
+
+    // mat.h / vec.h against glm
+    // -------------------------
+    const unsigned int MATRICES = 64; // inputs cycle through a small table so nothing is constant folded
+    std::vector<mat4> angelMatrices(MATRICES);
+    std::vector<glm::mat4> glmMatrices(MATRICES);
+    std::vector<vec4> angelVectors(MATRICES);
+    std::vector<glm::vec4> glmVectors(MATRICES);
+    for (unsigned int i = 0; i < MATRICES; i++)
+    {
+        float a = 0.1f * i;
+        angelMatrices[i] = Translate(a, 2.0f * a, -a) * RotateY(10.0f * a) * Scale(1.0f + a, 1.0f, 1.0f);
+        glmMatrices[i] = glm::scale(glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(a, 2.0f * a, -a)), glm::radians(10.0f * a), glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(1.0f + a, 1.0f, 1.0f));
+        angelVectors[i] = vec4(a, 1.0f - a, 2.0f * a, 1.0f);
+        glmVectors[i] = glm::vec4(a, 1.0f - a, 2.0f * a, 1.0f);
+    }
+    unsigned int n = 0;
+    benchmark("mat4*mat4/angel", [&]() { keep(angelMatrices[n % MATRICES] * angelMatrices[(n + 1) % MATRICES]); n++; });
+    benchmark("mat4*mat4/glm", [&]() { keep(glmMatrices[n % MATRICES] * glmMatrices[(n + 1) % MATRICES]); n++; });
+    benchmark("mat4*vec4/angel", [&]() { keep(angelMatrices[n % MATRICES] * angelVectors[(n + 1) % MATRICES]); n++; });
+    benchmark("mat4*vec4/glm", [&]() { keep(glmMatrices[n % MATRICES] * glmVectors[(n + 1) % MATRICES]); n++; });
+    benchmark("translate_rotate_scale/angel", [&]() {
+        float a = 0.1f * (n++ % MATRICES);
+        keep(Translate(a, 0.0f, -a) * RotateY(10.0f * a) * Scale(a, a, a));
+    });
+    benchmark("translate_rotate_scale/glm", [&]() {
+        float a = 0.1f * (n++ % MATRICES);
+        keep(glm::scale(glm::rotate(glm::translate(glm::mat4(1.0f), glm::vec3(a, 0.0f, -a)), glm::radians(10.0f * a), glm::vec3(0.0f, 1.0f, 0.0f)), glm::vec3(a, a, a)));
+    });
+    benchmark("perspective_lookat/angel", [&]() {
+        const vec4& eye = angelVectors[n++ % MATRICES];
+        keep(Perspective(45.0f, 1.5f, 0.1f, 1000.0f) * LookAt(eye, vec4(0.0f, 0.0f, 0.0f, 1.0f), vec4(0.0f, 1.0f, 0.0f, 0.0f)));
+    });
+    benchmark("perspective_lookat/glm", [&]() {
+        glm::vec3 eye(glmVectors[n++ % MATRICES]);
+        keep(glm::perspective(glm::radians(45.0f), 1.5f, 0.1f, 1000.0f) * glm::lookAt(eye, glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f)));
+    });
+    benchmark("normal_matrix/angel", [&]() { keep(Normal(angelMatrices[n++ % MATRICES])); });
+    benchmark("normal_matrix/glm", [&]() { keep(normalMatrix(glmMatrices[n++ % MATRICES])); });
+
+    // the model and normal matrices of every body, as computed each frame
+    float simulationTime = 0.0f;
+    benchmark("body_matrices/" + std::to_string(BODY_COUNT), [&]() {
+        for (unsigned int i = 0; i < BODY_COUNT; i++)
+        {
+            glm::mat4 model = BODIES[i].modelMatrix(simulationTime);
+            keep(model);
+            keep(normalMatrix(model));
+        }
+        simulationTime += TIME_SCALE / 60.0f;
+    });
+
+    // GL: createSphere, texture loading and Model::processMesh
+    // ---------------------------------------------------------
+#ifdef HAVE_EGL
+    HeadlessContext context(4, 4);
+    if (!context.isValid() || !gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress))
+    {
+        std::printf("no OpenGL context, GL benchmarks skipped\n");
+        return 0;
+    }
+    std::printf("GL benchmarks on %s\n", glGetString(GL_RENDERER));
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        unsigned int segments = sphereSegments[i];
+        benchmark("createSphere/" + std::to_string(segments), [&]() {
+            unsigned int VAO, VBO, EBO;
+            keep(createSphere(VAO, VBO, EBO, segments));
+            deleteVertexArray(VAO);
+        });
+    }
+    benchmark("loadTexture/" + earthPath.substr(earthPath.find_last_of('/') + 1), [&]() {
+        deleteTexture(loadTexture(earthPath.c_str()));
+    });
+    benchmark("loadCubemap/blue", [&]() {
+        deleteTexture(loadCubemap(faces));
+    });
+    std::vector<std::string> planetPaths;
+    for (unsigned int i = 0; i < BODY_COUNT; i++)
+        planetPaths.push_back(BODIES[i].texture);
+    benchmark("loadTextureArray/planets", [&]() {
+        deleteTexture(loadTextureArray(planetPaths));
+    });
+    TextureStreamer streamer;
+    benchmark("TextureStreamer/cubemap_blue", [&]() {
+        unsigned int texture = streamer.loadCubemap(faces);
+        streamer.finish();
+        deleteTexture(texture);
+    });
+    benchmark("TextureStreamer/planets", [&]() {
+        unsigned int texture = streamer.loadTextureArray(planetPaths);
+        streamer.finish();
+        deleteTexture(texture);
+    });
+    if (ktx2Exists(ktx2Path(earthPath)))
+    {
+        std::string bakedEarth = ktx2Path(earthPath);
+        benchmark("loadCompressedTexture/" + bakedEarth.substr(bakedEarth.find_last_of('/') + 1), [&]() {
+            deleteTexture(loadCompressedTexture(bakedEarth.c_str()));
+        });
+    }
+    std::vector<std::string> bakedPlanets = planetPaths;
+    if (preferKtx2(bakedPlanets))
+        benchmark("TextureStreamer/planets_ktx2", [&]() {
+            unsigned int texture = streamer.loadTextureArray(bakedPlanets);
+            streamer.finish();
+            deleteTexture(texture);
+        });
+
+    // the planets as 2D textures on a line RESIDENCY_SPACING apart, passed close by a camera sweeping along
+    // it: near textures want their finest levels, the budget forces the rest out
+    std::string residencyName = "TextureResidency/flyby_half_budget";
+    if (!filter || residencyName.find(filter) != std::string::npos)
+    {
+        const float RESIDENCY_SPACING = 10.0f, RESIDENCY_SPEED = 0.25f, RESIDENCY_DISTANCE = 3.0f;
+        size_t before = gpuMemory().bytes(GPU_MEMORY_TEXTURES);
+        std::vector<unsigned int> textures;
+        for (unsigned int i = 0; i < BODY_COUNT; i++)
+            textures.push_back(loadTexture(BODIES[i].texture));
+        size_t full = gpuMemory().bytes(GPU_MEMORY_TEXTURES) - before;
+        TextureResidency residency(full / 2);
+        for (unsigned int i = 0; i < BODY_COUNT; i++)
+            residency.track(textures[i], BODIES[i].texture);
+        float travelled = 0.0f, length = RESIDENCY_SPACING * BODY_COUNT;
+        benchmark(residencyName, [&]() {
+            glm::vec3 camera(std::fmod(travelled, length) - RESIDENCY_SPACING, 0.0f, -RESIDENCY_DISTANCE);
+            for (unsigned int i = 0; i < BODY_COUNT; i++)
+                residency.use(textures[i], glm::vec3(i * RESIDENCY_SPACING, 0.0f, 0.0f), 1.0f);
+            residency.update(camera, glm::vec3(RESIDENCY_SPEED * 60.0f, 0.0f, 0.0f), glm::radians(45.0f), 1080.0f);
+            travelled += RESIDENCY_SPEED;
+        });
+        residency.finish();
+        std::printf("  %llu levels dropped, %llu reloads (%llu prefetched), %.1f of %.1f MB resident, budget %.1f MB\n",
+                    residency.levelsDropped, residency.reloads, residency.prefetches, residency.bytesResident() / 1048576.0,
+                    residency.bytesFull() / 1048576.0, residency.budgetBytes() / 1048576.0);
+        for (unsigned int i = 0; i < BODY_COUNT; i++)
+        {
+            residency.untrack(textures[i]);
+            deleteTexture(textures[i]);
+        }
+    }
+
+    // Model::Draw through the RenderQueue: MODEL_COUNT copies of a synthetic model submitted far to near,
+    // then sorted by key and drawn into an offscreen target
+    std::string queueName = "RenderQueue/model_draw_execute";
+    if (!filter || queueName.find(filter) != std::string::npos)
+    {
+        const unsigned int MODEL_COUNT = 16, MODEL_MESHES = 8;
+        OffscreenTarget target(256, 256);
+        target.bind();
+        Shader shader("../../src/shader/6.4.cubemaps.vert", "../../src/shader/6.4.cubemaps.frag");
+        aiScene* scene = ModelBenchmark::createScene(16);
+        Model model = ModelBenchmark::createModel(scene, MODEL_MESHES);
+        delete scene;
+        RenderQueue queue;
+        benchmark(queueName, [&]() {
+            for (unsigned int i = MODEL_COUNT; i-- > 0;)
+                model.Draw(shader, queue, 10.0f * (i + 1), 1000.0f);
+            queue.execute();
+        });
+        glFinish();
+        std::printf("  %u commands, %u program changes per execute\n", queue.lastCommandCount, queue.lastProgramChanges);
+        for (unsigned int i = 0; i < model.meshes.size(); i++)
+            deleteVertexArray(model.meshes[i].VAO);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+
+    const unsigned int gridSides[] = { 32, 128, 320 };
+    for (unsigned int i = 0; i < 3; i++)
+    {
+        aiScene* scene = ModelBenchmark::createScene(gridSides[i]);
+        benchmark("processMesh/" + std::to_string(gridSides[i] * gridSides[i]) + "_vertices", [&]() {
+            Mesh mesh = ModelBenchmark::processMesh(scene);
+            deleteVertexArray(mesh.VAO);
+        });
+        delete scene;
+    }
+    glFinish();
+#else
+    std::printf("built without EGL, GL benchmarks skipped\n");
+#endif
+    return 0;
+}
@@ -0,0 +1,181 @@
+// Measures what Morton-ordered particle storage buys.
+//
+// usage: MortonBenchmark [belt particles] [steps] [resort interval]
+//
+// Runs the same belt twice, once in its original (random) order and once re-sorted along the Z-order
+// curve every [resort interval] steps, and reports for each the N-body step time and a neighbour query
+// (uniform grid, all particles within one cell size) together with hardware cache misses where the
+// kernel allows perf counters.
+#include "nbody.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// hardware cache miss counter for the calling thread; reports -1 when perf events are unavailable
+class CacheMissCounter
+{
+public:
+    CacheMissCounter() : fd(-1)
+    {
+#ifdef __linux__
+        perf_event_attr attributes;
+        memset(&attributes, 0, sizeof(attributes));
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.size = sizeof(attributes);
+        attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+        attributes.disabled = 1;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        fd = (int)syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheMissCounter()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+            close(fd);
+#endif
+    }
+
+    void start()
+    {
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+#endif
+    }
+
+    long long stop()
+    {
+        long long misses = -1;
+#ifdef __linux__
+        if (fd >= 0)
+        {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+            if (read(fd, &misses, sizeof(misses)) != sizeof(misses))
+                misses = -1;
+        }
+#endif
+        return misses;
+    }
+
+private:
+    int fd;
+};
+
+// counts, for every belt particle, the belt particles within radius of it, using a hashed uniform grid
+// with cells of that radius. Particles are visited and stored in memory order, so the access pattern
+// follows whatever order the system is in.
+unsigned long long countNeighbors(const NBodySystem& system, float radius)
+{
+    unsigned int begin = BODY_COUNT, n = system.count - BODY_COUNT;
+    unsigned int tableSize = 1;
+    while (tableSize < 2 * n)
+        tableSize <<= 1;
+
+    std::vector<unsigned int> cellOf(n), cellStart(tableSize + 1, 0), entries(n);
+    float toCell = 1.0f / radius;
+    for (unsigned int i = 0; i < n; i++)
+    {
+        int cx = (int)floorf(system.px[begin + i] * toCell);
+        int cy = (int)floorf(system.py[begin + i] * toCell);
+        int cz = (int)floorf(system.pz[begin + i] * toCell);
+        cellOf[i] = ((unsigned int)cx * 73856093u ^ (unsigned int)cy * 19349663u ^ (unsigned int)cz * 83492791u) & (tableSize - 1);
+        cellStart[cellOf[i] + 1]++;
+    }
+    for (unsigned int c = 0; c < tableSize; c++)
+        cellStart[c + 1] += cellStart[c];
+    std::vector<unsigned int> fill(cellStart.begin(), cellStart.end() - 1);
+    for (unsigned int i = 0; i < n; i++)
+        entries[fill[cellOf[i]]++] = begin + i;
+
+    unsigned long long found = 0;
+    float radius2 = radius * radius;
+    for (unsigned int i = begin; i < system.count; i++)
+    {
+        float x = system.px[i], y = system.py[i], z = system.pz[i];
+        int cx = (int)floorf(x * toCell), cy = (int)floorf(y * toCell), cz = (int)floorf(z * toCell);
+        for (int dz = -1; dz <= 1; dz++)
+            for (int dy = -1; dy <= 1; dy++)
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    unsigned int cell = ((unsigned int)(cx + dx) * 73856093u ^ (unsigned int)(cy + dy) * 19349663u ^ (unsigned int)(cz + dz) * 83492791u) & (tableSize - 1);
+                    for (unsigned int e = cellStart[cell]; e < cellStart[cell + 1]; e++)
+                    {
+                        unsigned int j = entries[e];
+                        float ex = system.px[j] - x, ey = system.py[j] - y, ez = system.pz[j] - z;
+                        if (ex * ex + ey * ey + ez * ez < radius2)
+                            found++;
+                    }
+                }
+    }
+    return found;
+}
+
+void run(const std::string& order, unsigned int particles, unsigned int steps, unsigned int resortInterval)
+{
+    NBodySystem system(particles);
+    system.resortInterval = resortInterval;
+    CacheMissCounter counter;
+
+    counter.start();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int s = 0; s < steps; s++)
+        system.step(0.01f);
+    double stepSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / steps;
+    long long stepMisses = counter.stop();
+
+    const unsigned int queries = 5;
+    unsigned long long neighbors = 0;
+    counter.start();
+    start = std::chrono::steady_clock::now();
+    for (unsigned int q = 0; q < queries; q++)
+        neighbors = countNeighbors(system, 0.25f);
+    double querySeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() / queries;
+    long long queryMisses = counter.stop();
+
+    double resortSeconds = 0.0;
+    if (resortInterval > 0)
+    {
+        start = std::chrono::steady_clock::now();
+        system.resort();
+        resortSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::cout << "order=" << order
+              << " bodies=" << system.count
+              << " resort_interval=" << resortInterval
+              << " step_seconds=" << stepSeconds
+              << " step_cache_misses=" << (stepMisses < 0 ? -1 : stepMisses / (long long)steps)
+              << " query_seconds=" << querySeconds
+              << " query_cache_misses=" << (queryMisses < 0 ? -1 : queryMisses / (long long)queries)
+              << " neighbors=" << neighbors
+              << " resort_seconds=" << resortSeconds << std::endl;
+}
+
+int main(int argc, char** argv)
+{
+    unsigned int particles = argc > 1 ? atoi(argv[1]) : 16384;
+    unsigned int steps = argc > 2 ? atoi(argv[2]) : 10;
+    unsigned int resortInterval = argc > 3 ? atoi(argv[3]) : 5;
+
+    run("random", particles, steps, 0);
+    run("morton", particles, steps, resortInterval > 0 ? resortInterval : 1);
+    return 0;
+}
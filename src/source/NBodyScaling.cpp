@@ -0,0 +1,60 @@
+// Strong-scaling report for the domain-decomposed N-body simulation.
+//
+// usage: NBodyScaling [belt particles] [steps] [max ranks]
+//
+// Runs the same problem with 1, 2, 4, ... max ranks (separate processes on this machine) and prints one
+// machine-readable line per run plus the speedup and parallel efficiency relative to a single rank.
+// Every run splits the belt into as many wedges as the largest run has ranks, so the multipole
+// approximation, and the work, is the same at every rank count and the speedup compares equal work.
+#include "nbody_domain.h"
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+int main(int argc, char** argv)
+{
+    unsigned int particles = argc > 1 ? atoi(argv[1]) : 16384;
+    unsigned int steps = argc > 2 ? atoi(argv[2]) : 20;
+    int maxRanks = argc > 3 ? atoi(argv[3]) : 8;
+    const float dt = 0.001f;
+
+    int domains = 1;
+    while (domains * 2 <= maxRanks)
+        domains *= 2;
+
+    double baseline = 0.0;
+    for (int ranks = 1; ranks <= maxRanks; ranks *= 2)
+    {
+        // everything shared must exist before the ranks are forked
+        NBodySystem system(particles, true);
+        DomainDecomposition decomposition(system, ranks, domains);
+        Communicator comm(ranks);
+        int rank = comm.spawn();
+
+        comm.barrier();
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (unsigned int s = 0; s < steps; s++)
+            decomposition.step(comm, dt);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (rank == 0)
+        {
+            if (ranks == 1)
+                baseline = seconds;
+            double speedup = baseline / seconds;
+            std::cout << "ranks=" << ranks
+                      << " domains=" << domains
+                      << " bodies=" << system.count
+                      << " steps=" << steps
+                      << " seconds=" << seconds
+                      << " steps_per_second=" << steps / seconds
+                      << " speedup=" << speedup
+                      << " efficiency=" << speedup / ranks
+                      << " rank0_direct=" << decomposition.directInteractions
+                      << " rank0_multipole=" << decomposition.multipoleInteractions << std::endl;
+        }
+        comm.finish();
+    }
+    return 0;
+}
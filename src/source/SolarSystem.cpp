@@ -9,20 +9,53 @@
 #include "camera.h"
 #include "model.h"
 #include "filesystem.h"
+#include "orbit.h"
+#include "trajectory_writer.h"
+#include "nbody.h"
+#include "nbody_gpu.h"
+#include "indirect_renderer.h"
+#include "frame_uniforms.h"
+#include "render_queue.h"
+#include "frame_allocator.h"
+#include "gpu_memory.h"
+#include "star_field.h"
+#include "offscreen_target.h"
+#include "frame_profiler.h"
+#include "camera_flight.h"
+#include "sphere.h"
+#include "texture_loader.h"
+#include "texture_streamer.h"
+#include "trace.h"
+#include "startup_report.h"
+#include "virtual_texture.h"
+#ifndef _WIN32
+#include "ephemeris_server.h"
+#endif
+#ifdef HAVE_EGL
+#include "headless_context.h"
+#endif
 
 #include <iostream>
+#include <memory>
+#include <cstring>
+#include <cstdlib>
+#include <chrono>
+#include <algorithm>
 
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
 void processInput(GLFWwindow* window);
-unsigned int loadTexture(const char* path);
-unsigned int loadCubemap(vector<std::string> faces);
-void createSphere(unsigned int& VAO, unsigned int& VBO, unsigned int& EBO);
+void runNBodyBenchmark(unsigned int particles, unsigned int steps);
+void drawBodies(void* renderer, void* textures);
+void drawAsteroids(void* nbody, void* nbodyGpu);
+void drawSkybox(void* vertexArray, void* cubemap);
+void drawStars(void* starField, void*);
 
 // settings
 const unsigned int SCR_WIDTH = 1800;
 const unsigned int SCR_HEIGHT = 1200;
+const float FAR_PLANE = 1000.0f;
 
 // camera
 // Position the camera slightly higher and look towards the center.
@@ -37,79 +70,267 @@ bool firstMouse = true;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
+// --trace output, also written on demand with the T key
+const char* tracePath = NULL;
+bool traceKeyDown = false;
+
+// video memory report, printed on demand with the M key and by --memory-report at exit
+bool memoryKeyDown = false;
+
 bool rotFlg1 = false;
 float angle = 0.0f;
 
-//sphere properties
-//unsigned int sphereVAO;
-//unsigned int sphereVBO, sphereEBO;
-unsigned int indexCount;
-//sun VAO
-unsigned int sunVAO, sunVBO, sunEBO;
-//earth VAO
-unsigned int earthVAO, earthVBO, earthEBO;
-//Mercury VAO
-unsigned int mercVAO, mercVBO, mercEBO;
-//Venus VAO
-unsigned int venusVAO, venusVBO, venusEBO;
-//Mars VAO
-unsigned int marsVAO, marsVBO, marsEBO;
-//Jupiter VAO
-unsigned int jupiterVAO, jupiterVBO, jupiterEBO;
-// saturn VAO
-unsigned int saturnVAO, saturnVBO, saturnEBO;
-//uranus VAO
-unsigned int uranusVAO, uranusVBO, uranusEBO;
-//neptune VAO
-unsigned int neptuneVAO, neptuneVBO, neptuneEBO;
-
-//planet textures
-
-unsigned int sunTexture;
-unsigned int mercTexture;
-unsigned int venusTexture;
-unsigned int earthTexture;
-unsigned int marsTexture;
-unsigned int jupiterTexture;
-unsigned int saturnTexture;
-unsigned int uranusTexture;
-unsigned int neptuneTexture;
-
-
-
-
-int main()
+//sphere properties, one sphere mesh in the indirect renderer shared by every body
+unsigned int sphereMesh;
+unsigned int bodyMaterials[BODY_COUNT];
+
+//planet textures, one layer per body plus one for the asteroids
+unsigned int planetTextures;
+const unsigned int ASTEROID_LAYER = BODY_COUNT;
+
+// --virtual-texture: the sun's layer paged in from the 8k image instead, bound for the bodies pass
+const char* const VIRTUAL_SUN_TEXTURE = "../../src/resources/textures/planets/8k_sun.jpg";
+const unsigned int SUN_LAYER = 0;
+VirtualTexture* virtualSun = NULL;
+
+// N-body asteroid belt
+const float NBODY_DT = 0.01f;              // simulation days per step
+const unsigned int NBODY_MAX_SUBSTEPS = 8; // the belt slows down rather than stalling the frame
+const unsigned int NBODY_RESORT_INTERVAL = 50; // steps between Morton re-sorts of the belt on the CPU
+unsigned int asteroidVAO, asteroidVBO, asteroidEBO;
+unsigned int asteroidIndexCount;
+
+// procedural sky written to the --stars catalog path when the file does not exist yet
+const unsigned int STAR_COUNT = 120000;
+
+// headless and benchmark modes advance a fixed time per frame, so runs are repeatable and frames can be compared
+const float HEADLESS_FRAME_TIME = 1.0f / 60.0f;
+
+// render loop phases timed by --profile, each runs at most once per frame
+enum FramePhase {
+    PHASE_INPUT,
+    PHASE_SIMULATION, // camera, orbits, N-body steps and uploads, draw submission
+    PHASE_BODIES,
+    PHASE_ASTEROIDS,
+    PHASE_SKY,
+    PHASE_PRESENT,    // buffer swap, or the frame dump in headless mode
+    PHASE_COUNT
+};
+const char* const PHASE_NAMES[PHASE_COUNT] = { "input", "simulation", "bodies", "asteroids", "sky", "present" };
+
+// per-frame counters recorded next to the phase times
+enum FrameCounter {
+    COUNTER_STATE_HITS,
+    COUNTER_STATE_MISSES,
+    COUNTER_QUEUE_COMMANDS,
+    COUNTER_PROGRAM_CHANGES,
+    COUNTER_ALLOCATOR_BYTES,
+    COUNTER_ALLOCATOR_STALLS,
+    COUNTER_UPLOAD_BYTES,     // everything sent to the GPU in the frame, see GpuMemory
+    COUNTER_COUNT
+};
+const char* const COUNTER_NAMES[COUNTER_COUNT] = {
+    "state_hits", "state_misses", "queue_commands", "program_changes", "allocator_bytes", "allocator_stalls", "upload_bytes"
+};
+
+// per-frame dynamic data, bytes per frame besides the belt positions
+const unsigned int FRAME_ALLOCATOR_SIZE = 1 << 20;
+
+// terminates GLFW when main returns. Declared before any GL object in main, so it runs after their
+// destructors, while the window's context is still current for them.
+struct GlfwSession
+{
+    bool initialized;
+
+    GlfwSession() : initialized(false) {}
+
+    ~GlfwSession()
+    {
+        if (initialized)
+            glfwTerminate();
+    }
+};
+
+
+
+
+int main(int argc, char** argv)
 {
-    // glfw: initialize and configure
-    // ------------------------------
-    glfwInit();
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-
-    // glfw window creation
+    // command line options
     // --------------------
-    GLFWwindow* window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Final Project Solar System/Planets Noel Soto", NULL, NULL);
-    if (window == NULL)
+    const char* trajectoryPath = NULL;
+    float trajectoryInterval = 1.0f;
+    const char* serveSocket = NULL;
+    unsigned int nbodyParticles = 0;
+    bool nbodyOnGpu = false;
+    unsigned int nbodyBenchmarkSteps = 0;
+    const char* starCatalogPath = NULL;
+    unsigned int headlessFrames = 0;
+    const char* frameDumpPrefix = NULL;
+    const char* profilePath = NULL;
+    const char* benchmarkPath = NULL;
+    const char* startupMode = NULL;
+    double startupBudgetMs = 0.0;
+    unsigned int virtualTextureMB = 0;
+    bool memoryReport = false;
+    for (int i = 1; i < argc; i++)
     {
-        std::cout << "Failed to create GLFW window" << std::endl;
-        glfwTerminate();
+        if (strcmp(argv[i], "--export-trajectory") == 0 && i + 1 < argc)
+            trajectoryPath = argv[++i];
+        else if (strcmp(argv[i], "--export-interval") == 0 && i + 1 < argc)
+            trajectoryInterval = (float)atof(argv[++i]);
+        else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+            serveSocket = argv[++i];
+        else if (strcmp(argv[i], "--nbody") == 0 && i + 1 < argc)
+            nbodyParticles = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--nbody-gpu") == 0)
+            nbodyOnGpu = true;
+        else if (strcmp(argv[i], "--nbody-benchmark") == 0 && i + 1 < argc)
+            nbodyBenchmarkSteps = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--stars") == 0 && i + 1 < argc)
+            starCatalogPath = argv[++i];
+        else if (strcmp(argv[i], "--headless") == 0 && i + 1 < argc)
+            headlessFrames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--dump-frames") == 0 && i + 1 < argc)
+            frameDumpPrefix = argv[++i];
+        else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+            profilePath = argv[++i];
+        else if (strcmp(argv[i], "--benchmark") == 0 && i + 1 < argc)
+            benchmarkPath = argv[++i];
+        else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc)
+            tracePath = argv[++i];
+        else if (strcmp(argv[i], "--startup-report") == 0 && i + 1 < argc)
+            startupMode = argv[++i];
+        else if (strcmp(argv[i], "--startup-budget") == 0 && i + 1 < argc)
+            startupBudgetMs = atof(argv[++i]);
+        else if (strcmp(argv[i], "--virtual-texture") == 0 && i + 1 < argc)
+            virtualTextureMB = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--memory-report") == 0)
+            memoryReport = true;
+    }
+
+    // timeline of startup and every frame, before any thread that records into it starts
+    if (tracePath)
+    {
+        Trace::enable();
+        Trace::setThreadName("main");
+    }
+
+    // server mode: answer ephemeris queries from the orbital model without opening a window
+    if (serveSocket)
+    {
+#ifndef _WIN32
+        EphemerisServer server(serveSocket);
+        if (!server.isOpen())
+            return -1;
+        server.serve();
+        return 0;
+#else
+        std::cout << "--serve requires Unix domain sockets" << std::endl;
         return -1;
+#endif
     }
-    glfwMakeContextCurrent(window);
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-    glfwSetCursorPosCallback(window, mouse_callback);
-    glfwSetScrollCallback(window, scroll_callback);
 
-    // tell GLFW to capture our mouse
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+    // startup report: time every startup phase up to the first finished frame, then exit
+    std::unique_ptr<StartupReport> startup;
+    if (startupMode || startupBudgetMs > 0.0)
+    {
+        std::string mode = startupMode ? startupMode : "warm";
+        if (mode != "cold" && mode != "warm")
+        {
+            std::cout << "--startup-report takes cold or warm" << std::endl;
+            return -1;
+        }
+        if (mode == "cold")
+        {
+            unsigned int files = StartupReport::evictFromPageCache("../../src/resources") + StartupReport::evictFromPageCache("../../src/shader");
+            std::cout << "startup: dropped " << files << " asset files from the page cache" << std::endl;
+        }
+        startup.reset(new StartupReport(mode, startupBudgetMs));
+    }
 
-    // glad: load all OpenGL function pointers
-    // ---------------------------------------
-    if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+    // headless mode: no window, the scene renders into a framebuffer object for a fixed number of frames
+    bool headless = headlessFrames > 0;
+    GLFWwindow* window = NULL;
+    GlfwSession glfw;
+#ifdef HAVE_EGL
+    std::unique_ptr<HeadlessContext> headlessContext;
+#endif
+    if (headless)
     {
-        std::cout << "Failed to initialize GLAD" << std::endl;
+#ifdef HAVE_EGL
+        {
+            TraceScope trace("eglInitialize");
+            headlessContext.reset(new HeadlessContext(4, 4)); // compute shaders, persistently mapped buffers
+        }
+        if (!headlessContext->isValid())
+            return -1;
+        if (!gladLoadGLLoader((GLADloadproc)HeadlessContext::getProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+#else
+        std::cout << "--headless requires EGL" << std::endl;
         return -1;
+#endif
+    }
+    else
+    {
+        // glfw: initialize and configure
+        // ------------------------------
+        {
+            TraceScope trace("glfwInit");
+            glfw.initialized = glfwInit() == GLFW_TRUE;
+        }
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 4); // compute shaders, persistently mapped buffers
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+        // glfw window creation
+        // --------------------
+        {
+            TraceScope trace("glfwCreateWindow");
+            window = glfwCreateWindow(SCR_WIDTH, SCR_HEIGHT, "Final Project Solar System/Planets Noel Soto", NULL, NULL);
+        }
+        if (window == NULL)
+        {
+            std::cout << "Failed to create GLFW window" << std::endl;
+            return -1;
+        }
+        glfwMakeContextCurrent(window);
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+        glfwSetCursorPosCallback(window, mouse_callback);
+        glfwSetScrollCallback(window, scroll_callback);
+
+        // tell GLFW to capture our mouse
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+
+        // benchmark frame times must not be capped by the display's refresh rate
+        if (benchmarkPath)
+            glfwSwapInterval(0);
+
+        // glad: load all OpenGL function pointers
+        // ---------------------------------------
+        if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
+        {
+            std::cout << "Failed to initialize GLAD" << std::endl;
+            return -1;
+        }
+    }
+
+    if (startup)
+        startup->mark("context");
+
+    // without a window every frame goes to an offscreen framebuffer, optionally written to disk
+    std::unique_ptr<OffscreenTarget> offscreen;
+    std::unique_ptr<FrameDumper> frameDumper;
+    if (headless)
+    {
+        offscreen.reset(new OffscreenTarget(SCR_WIDTH, SCR_HEIGHT));
+        offscreen->bind();
+        if (frameDumpPrefix)
+            frameDumper.reset(new FrameDumper(frameDumpPrefix, SCR_WIDTH, SCR_HEIGHT));
     }
 
     // configure global opengl state
@@ -124,6 +345,8 @@ int main()
     //sphere Shaders
 
     Shader sphereShader("../../src/shader/sphereVert.vert", "../../src/shader/sphereFrag.frag");
+    if (startup)
+        startup->mark("shaders");
 
 
     // set up vertex data (and buffer(s)) and configure vertex attributes
@@ -175,64 +398,120 @@ int main()
          1.0f, -1.0f,  1.0f
     };
 
-    /*Creating the sphere for each planet, each has their own VAO, VBO, and EBO so that i can perform different actions on each one*/
-    //sun sphere
-    createSphere(sunVAO, sunVBO, sunEBO);
-    //mercury sphere
-    createSphere(mercVAO, mercVBO, mercEBO);
-    //venus sphere
-    createSphere(venusVAO, venusVBO, venusEBO);
-    //earth sphere
-    createSphere(earthVAO, earthVBO, earthEBO);
-    //mars sphere
-    createSphere(marsVAO, marsVBO, earthEBO);
-    //jupiter sphere
-    createSphere(jupiterVAO, jupiterVBO, jupiterEBO);
-    //saturn sphere
-    createSphere(saturnVAO, saturnVBO, saturnEBO);
-    //uranus sphere
-    createSphere(uranusVAO, uranusVBO, uranusEBO);
-    //neptune sphere
-    createSphere(neptuneVAO, neptuneVBO, neptuneEBO);
+    // per-frame dynamic data: the Frame uniform block, per-object data and streamed belt positions
+    FrameAllocator frameAllocator(FRAME_ALLOCATOR_SIZE + (nbodyParticles + BODY_COUNT) * 4 * sizeof(float));
 
+    // one sphere for all bodies, every body is an object of the indirect renderer
+    IndirectRenderer renderer(frameAllocator);
+    {
+        TraceScope trace("sphere mesh");
+        vector<Vertex> sphereVertices;
+        vector<unsigned int> sphereIndices;
+        buildSphere(64, sphereVertices, sphereIndices);
+        sphereMesh = renderer.addMesh(sphereVertices, sphereIndices, GL_TRIANGLE_STRIP);
+    }
+    for (unsigned int i = 0; i < BODY_COUNT; i++)
+        bodyMaterials[i] = renderer.addMaterial(i);
 
-   
     // skybox VAO
     unsigned int skyboxVAO, skyboxVBO;
     glGenVertexArrays(1, &skyboxVAO);
     glGenBuffers(1, &skyboxVBO);
-    glBindVertexArray(skyboxVAO);
+    glState().bindVertexArray(skyboxVAO);
     glBindBuffer(GL_ARRAY_BUFFER, skyboxVBO);
     glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
+    gpuMemory().allocate(GpuMemory::BUFFER, skyboxVBO, GPU_MEMORY_MESHES, "skybox cube", sizeof(skyboxVertices));
+    gpuMemory().uploaded(sizeof(skyboxVertices));
     glEnableVertexAttribArray(0);
     glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
+    if (startup)
+        startup->mark("meshes");
+
     // load textures
-    // ------------- textures for planets
+    // ------------- decoded on worker threads and uploaded through pixel buffers, finished before the first frame;
+    // textures baked by TextureBaker are uploaded block-compressed with their mipmaps instead
+    TextureStreamer textureStreamer;
+    // textures for planets, packed into one texture array in BODIES order
+    vector<std::string> planetPaths;
+    for (unsigned int i = 0; i < BODY_COUNT; i++)
+        planetPaths.push_back(BODIES[i].texture);
+    planetPaths.push_back("../../src/resources/textures/planets/2k_moon.jpg"); // ASTEROID_LAYER
+    preferKtx2(planetPaths);
+    planetTextures = textureStreamer.loadTextureArray(planetPaths);
+
+    //textures for skybox, or a star catalog drawn as points instead
+    unsigned int cubemapTexture = 0;
+    std::unique_ptr<StarField> starField;
+    std::unique_ptr<Shader> starsShader;
+    if (starCatalogPath)
+    {
+        vector<Star> stars;
+        if (!loadStarCatalog(starCatalogPath, stars))
+        {
+            stars = generateStarCatalog(STAR_COUNT);
+            saveStarCatalog(starCatalogPath, stars);
+        }
+        starField.reset(new StarField(stars));
+        starsShader.reset(new Shader("../../src/shader/stars.vert", "../../src/shader/stars.frag"));
+    }
+    else
+    {
+        vector<std::string> faces
+        {
+            FileSystem::getPath("resources/textures/skybox/blue/bkg1_right.png"),
+            FileSystem::getPath("resources/textures/skybox/blue/bkg1_left.png"),
+            FileSystem::getPath("resources/textures/skybox/blue/bkg1_top.png"),
+            FileSystem::getPath("resources/textures/skybox/blue/bkg1_bot.png"),
+            FileSystem::getPath("resources/textures/skybox/blue/bkg1_front.png"),
+            FileSystem::getPath("resources/textures/skybox/blue/bkg1_back.png"),
+        };
+        preferKtx2(faces);
+        cubemapTexture = textureStreamer.loadCubemap(faces);
+    }
+    if (startup)
+        startup->mark("sky");
 
-    sunTexture = loadTexture("../../src/resources/textures/planets/2k_sun.jpg");
-    mercTexture = loadTexture("../../src/resources/textures/planets/2k_mercury.jpg");
-    venusTexture = loadTexture("../../src/resources/textures/planets/2k_venus.jpg");
-    earthTexture = loadTexture("../../src/resources/textures/planets/earth2k.jpg");
-    marsTexture = loadTexture("../../src/resources/textures/planets/2k_mars.jpg");
-    jupiterTexture = loadTexture("../../src/resources/textures/planets/2k_jupiter.jpg");
-    saturnTexture = loadTexture("../../src/resources/textures/planets/2k_saturn.jpg");
-    uranusTexture = loadTexture("../../src/resources/textures/planets/2k_uranus.jpg");
-    neptuneTexture = loadTexture("../../src/resources/textures/planets/2k_neptune.jpg");
+    // 8k sun: decoded on its own thread, the 2k layer stands in until its coarsest page is resident
+    std::unique_ptr<VirtualTexture> sunTexture;
+    if (virtualTextureMB > 0)
+    {
+        sunTexture.reset(new VirtualTexture(VIRTUAL_SUN_TEXTURE, (size_t)virtualTextureMB << 20));
+        sunTexture->attach(sphereShader, SUN_LAYER);
+        virtualSun = sunTexture.get();
+    }
 
+    // N-body asteroid belt: low resolution spheres drawn straight from the simulation's position buffer
+    // --------------------
+    if (nbodyBenchmarkSteps > 0)
+    {
+        runNBodyBenchmark(nbodyParticles > 0 ? nbodyParticles : 4096, nbodyBenchmarkSteps);
+        return 0;
+    }
+    std::unique_ptr<NBodySystem> nbody;
+    std::unique_ptr<NBodyGpu> nbodyGpu;
+    std::unique_ptr<Shader> nbodyShader;
+    float nbodyAccumulator = 0.0f;
+    if (nbodyParticles > 0)
+    {
+        nbody.reset(new NBodySystem(nbodyParticles));
+        nbody->resortInterval = NBODY_RESORT_INTERVAL;
+        nbodyGpu.reset(new NBodyGpu(*nbody));
+        nbodyShader.reset(new Shader("../../src/shader/nbodySphere.vert", "../../src/shader/sphereFrag.frag"));
+        // constant for the whole run
+        nbodyShader->uniform<int>("firstBody").set(BODY_COUNT);
+        nbodyShader->uniform<float>("bodyScale").set(0.03f);
+        nbodyShader->uniform<int>("layer").set(ASTEROID_LAYER);
+        asteroidIndexCount = createSphere(asteroidVAO, asteroidVBO, asteroidEBO, 8);
+    }
 
+    if (startup)
+        startup->mark("belt");
 
-    //textures for skybox
-    vector<std::string> faces
-    {
-        FileSystem::getPath("resources/textures/skybox/blue/bkg1_right.png"),
-        FileSystem::getPath("resources/textures/skybox/blue/bkg1_left.png"),
-        FileSystem::getPath("resources/textures/skybox/blue/bkg1_top.png"),
-        FileSystem::getPath("resources/textures/skybox/blue/bkg1_bot.png"),
-        FileSystem::getPath("resources/textures/skybox/blue/bkg1_front.png"),
-        FileSystem::getPath("resources/textures/skybox/blue/bkg1_back.png"),
-    };
-    unsigned int cubemapTexture = loadCubemap(faces);
+    // the decodes ran while the sky and the belt were set up
+    textureStreamer.finish();
+    if (startup)
+        startup->mark("textures");
 
     // shader configuration
     // --------------------
@@ -242,311 +521,298 @@ int main()
     skyboxShader.use();
     skyboxShader.setInt("skybox", 0);
 
+    // draws are recorded during the frame and executed sorted by state
+    RenderQueue renderQueue;
+
+    // camera and time constants, shared by every program through the Frame uniform block
+    FrameUniformBuffer frameUniforms(frameAllocator);
+
+    // trajectory export runs on its own thread, the render loop only enqueues samples
+    std::unique_ptr<TrajectoryWriter> trajectory;
+    if (trajectoryPath)
+        trajectory.reset(new TrajectoryWriter(trajectoryPath, trajectoryInterval));
+
+    // CPU and GPU time of every phase, reported and written to CSV at exit
+    std::unique_ptr<FrameProfiler> profiler;
+    if (profilePath)
+    {
+        profiler.reset(new FrameProfiler(vector<std::string>(PHASE_NAMES, PHASE_NAMES + PHASE_COUNT),
+                                         vector<std::string>(COUNTER_NAMES, COUNTER_NAMES + COUNTER_COUNT)));
+        renderQueue.setProfiler(profiler.get());
+    }
+    unsigned long long allocatorStalls = 0;
+
+    // benchmark: the camera follows a fixed flight instead of the input, and the run ends with the flight
+    std::unique_ptr<CameraFlight> benchmark;
+    if (benchmarkPath)
+        benchmark.reset(new CameraFlight());
+    bool fixedClock = headless || benchmark;
+    if (startup)
+        startup->mark("setup");
+
     // render loop
     // -----------
-    while (!glfwWindowShouldClose(window))
+    unsigned int frameIndex = 0;
+    std::chrono::steady_clock::time_point loopStart = std::chrono::steady_clock::now();
+    while ((benchmark ? frameIndex < benchmark->frameCount() : !headless || frameIndex < headlessFrames) &&
+           (headless || !glfwWindowShouldClose(window)))
     {
+        std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+        TraceScope traceFrame("frame");
+
         // per-frame time logic
     // --------------------
-        float currentFrame = static_cast<float>(glfwGetTime());
+        float currentFrame = fixedClock ? frameIndex * HEADLESS_FRAME_TIME : static_cast<float>(glfwGetTime());
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
+        if (profiler)
+            profiler->beginFrame();
+        glState().beginFrame(); // bind hit/miss counters of the previous frame move to lastFrameCounters()
+        gpuMemory().beginFrame();
+        frameAllocator.beginFrame(); // waits only if the GPU is still reading this region, three frames back
+        textureStreamer.update(); // textures requested at runtime, a bounded amount of uploads per frame
+        if (sunTexture)
+            sunTexture->beginFrame(); // pages requested three frames ago
 
         // input
         // -----
-        processInput(window);
+        {
+            ProfileScope scope(profiler.get(), PHASE_INPUT);
+            TraceScope trace("input");
+            if (window && !benchmark)
+                processInput(window);
+        }
 
         // render
         // ------
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+        if (starField)
+            glClearColor(0.0f, 0.0f, 0.0f, 1.0f); // stars only cover single pixels
+        else
+            glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glm::mat4 view = camera.GetViewMatrix();
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 1000.0f);
-
-        // activate sphere shader
-        sphereShader.use();
-
-        // set shader uniforms
-        sphereShader.setMat4("view", view);
-        sphereShader.setMat4("projection", projection);
-        sphereShader.setVec3("cameraPos", camera.Position);
-
+        if (profiler)
+            profiler->beginPhase(PHASE_SIMULATION);
+        if (Trace::enabled())
+            Trace::begin("simulation");
         // Time Warping
-        float timeScale = 10.0f; // speed up time so that 1 real second = 1 simulation year
-        float simulationTime = timeScale * (float)glfwGetTime(); // this gives the time in simulation days since the program started
-        float sizeScale = 2.0;
-
-        // Draw the sun
-        glm::mat4 sunModel = glm::mat4(1.0f);
-
-        // rotate the sun around its own y-axis
-        // The Sun rotates approximately once every 27 Earth days near its equator.
-        float sunRotationSpeed = simulationTime / 27.0f;
-        sunModel = glm::rotate(sunModel, sunRotationSpeed, glm::vec3(0.0f, 1.0f, 0.0f));
-
-        sunModel = glm::scale(sunModel, glm::vec3(2.0f, 2.0f, 2.0f)); // scale the sun
-
-        sphereShader.setMat4("model", sunModel);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, sunTexture);
-        glBindVertexArray(sunVAO);
-        glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-
-
-
-        // Draw Mercury
-        glm::mat4 mercModel = glm::mat4(1.0f); // reset model matrix 
-
-        // Mercury's rotation period is 58.6 Earth days
-    // Mercury's year is 88 Earth days
-        float mercRotationSpeed = simulationTime / 86.6f;
-        float mercOrbitSpeed = simulationTime / 88.0f;
-
-        // Rotate Mercury around the Sun
-        float mercOrbitRadius = 5.0f;
-        mercModel = glm::translate(mercModel, glm::vec3(mercOrbitRadius * cos(mercOrbitSpeed), 0.0f, mercOrbitRadius * sin(mercOrbitSpeed))); // move the planet in a circular path
-        mercModel = glm::rotate(mercModel, mercRotationSpeed, glm::vec3(0.0f, 1.0f, 0.0f)); // rotate the planet around its own y-axis
-
-        mercModel = glm::scale(mercModel, glm::vec3(0.10f * sizeScale, 0.10f * sizeScale, 0.10f * sizeScale)); // scale down the planet
-        sphereShader.setMat4("model", mercModel);
-        glBindTexture(GL_TEXTURE_2D, mercTexture);
-        glBindVertexArray(mercVAO);
-        glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-
-        // Draw Venus
-        glm::mat4 venusModel = glm::mat4(1.0f); // reset model matrix 
-
-        float venusRotationSpeed = simulationTime / 90.0f;
-        float venusOrbitSpeed = simulationTime / 225.0f;
-
-        // Rotate venus around the Sun
-        float VenusOrbitRadius = 10.0f;
-        venusModel = glm::translate(venusModel, glm::vec3(VenusOrbitRadius * cos(venusOrbitSpeed), 0.0f, VenusOrbitRadius * sin(venusOrbitSpeed)));
-        venusModel = glm::rotate(venusModel, venusRotationSpeed, glm::vec3(0.0f, 1.0f, 0.0f));
-
-        venusModel = glm::scale(venusModel, glm::vec3(0.095f * sizeScale, 0.095f * sizeScale, 0.095f * sizeScale)); // scale down the planet
-        sphereShader.setMat4("model", venusModel);
-        glBindTexture(GL_TEXTURE_2D, venusTexture);
-        glBindVertexArray(venusVAO);
-        glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-
-        // Draw the earth
-        glm::mat4 earthModel = glm::mat4(1.0f); // reset model matrix 
-
-        // Earth: rotation period = 1 Earth day, year = 1 Earth year
-        float earthRotationSpeed = simulationTime/ 10;
-        float earthOrbitSpeed = simulationTime/ 200;
-
-        // Rotate the Earth around the Sun
-        float earthOrbitRadius = 15.0f;
-        earthModel = glm::translate(earthModel, glm::vec3(earthOrbitRadius * cos(earthOrbitSpeed), 0.0f, earthOrbitRadius * sin(earthOrbitSpeed)));
-        earthModel = glm::rotate(earthModel, earthRotationSpeed, glm::vec3(0.0f, 1.0f, 0.0f));
-
-        earthModel = glm::scale(earthModel, glm::vec3(0.1f * sizeScale, 0.1f * sizeScale, 0.1f * sizeScale)); // scale down the planet
-        sphereShader.setMat4("model", earthModel);
-        glBindTexture(GL_TEXTURE_2D, earthTexture);
-        glBindVertexArray(earthVAO);
-        glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-
-        // Draw mars
-        glm::mat4 marsModel = glm::mat4(1.0f); // reset model matrix 
-
-        // Mars: rotation period = 1.03 Earth days, year = 1.88 Earth years
-        float marsRotationSpeed = simulationTime / 10.5f;
-        float marsOrbitSpeed = simulationTime / 10.88f;
-
-        // Rotate around the Sun
-        float marsOrbitRadius = 20.0f;
-        marsModel = glm::translate(marsModel, glm::vec3(marsOrbitRadius * cos(marsOrbitSpeed), 0.0f, marsOrbitRadius * sin(marsOrbitSpeed)));
-        marsModel = glm::rotate(marsModel, marsRotationSpeed, glm::vec3(0.0f, 1.0f, 0.0f));
-
-        marsModel = glm::scale(marsModel, glm::vec3(0.053f * sizeScale, 0.053f * sizeScale, 0.053f * sizeScale)); // scale down the planet
-        sphereShader.setMat4("model", marsModel);
-        glBindTexture(GL_TEXTURE_2D, marsTexture);
-        glBindVertexArray(marsVAO);
-        glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-
-        // Draw Jupiter
-        glm::mat4 jupiterModel = glm::mat4(1.0f); // reset model matrix 
-
-        // Jupiter: rotation period = 0.41 Earth days, year = 11.86 Earth years
-        float jupiterRotationSpeed = simulationTime / 0.41f;
-        float jupiterOrbitSpeed = simulationTime / 11.86f;
-
-        // Rotate around the Sun
-        float jupiterOrbitRadius = 25.0f;
-        jupiterModel = glm::translate(jupiterModel, glm::vec3(jupiterOrbitRadius * cos(jupiterOrbitSpeed), 0.0f, jupiterOrbitRadius * sin(jupiterOrbitSpeed)));
-        jupiterModel = glm::rotate(jupiterModel, jupiterRotationSpeed, glm::vec3(0.0f, 1.0f, 0.0f));
-
-        jupiterModel = glm::scale(jupiterModel, glm::vec3(1.0f , 1.0f , 1.0f )); // scale down the planet
-        sphereShader.setMat4("model", jupiterModel);
-        glBindTexture(GL_TEXTURE_2D, jupiterTexture);
-        glBindVertexArray(jupiterVAO);
-        glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-
-
-        // Draw saturn
-        glm::mat4 saturnModel = glm::mat4(1.0f); // reset model matrix 
-
-        // Saturn: rotation period = 0.45 Earth days, year = 29.46 Earth years
-        float saturnRotationSpeed = simulationTime / 0.45f;
-        float saturnOrbitSpeed = simulationTime / 29.46f;
-
-        // Rotate around the Sun
-        float saturnOrbitRadius = 30.0f;
-        saturnModel = glm::translate(saturnModel, glm::vec3(saturnOrbitRadius * cos(saturnOrbitSpeed), 0.0f, saturnOrbitRadius * sin(saturnOrbitSpeed)));
-        saturnModel = glm::rotate(saturnModel, saturnRotationSpeed, glm::vec3(0.0f, 1.0f, 0.0f));
-
-        saturnModel = glm::scale(saturnModel, glm::vec3(0.83f , 0.83f , 0.83f )); // scale down the planet
-        sphereShader.setMat4("model", saturnModel);
-        glBindTexture(GL_TEXTURE_2D, saturnTexture);
-        glBindVertexArray(saturnVAO);
-        glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-
-        // Draw Uranus
-        glm::mat4 uranusModel = glm::mat4(1.0f); // reset model matrix 
-
-        // Uranus: rotation period = 0.72 Earth days, year = 84 Earth years
-        float uranusRotationSpeed = simulationTime / 0.72f;
-        float uranusOrbitSpeed = simulationTime / 84.0f;
-
-        // Rotate uranus around the Sun
-        float uranusOrbitRadius = 35.0f;
-        uranusModel = glm::translate(uranusModel, glm::vec3(uranusOrbitRadius * cos(uranusOrbitSpeed), 0.0f, uranusOrbitRadius * sin(uranusOrbitSpeed)));
-        uranusModel = glm::rotate(uranusModel, uranusRotationSpeed, glm::vec3(0.0f, 1.0f, 0.0f));
-      
-        uranusModel = glm::scale(uranusModel, glm::vec3(0.36f * sizeScale, 0.36f * sizeScale, 0.36f * sizeScale)); // scale down the planet
-        sphereShader.setMat4("model", uranusModel);
-        glBindTexture(GL_TEXTURE_2D, uranusTexture);
-        glBindVertexArray(uranusVAO);
-        glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-
-      
-        // Draw neptune
-        glm::mat4 neptuneModel = glm::mat4(1.0f); // reset model matrix 
-
-        // Neptune's rotation period is 0.67 Earth days
-        // Neptune's year is 165 Earth years
-        float neptuneRotationSpeed = simulationTime / 0.67f;
-        float neptuneOrbitSpeed = simulationTime / 165.0f; 
-
-        // Rotate around the Sun
-        float neptuneOrbitRadius = 40.0f;
-        // Rotate Neptune around the Sun
-        neptuneModel = glm::translate(neptuneModel, glm::vec3(neptuneOrbitRadius * cos(neptuneOrbitSpeed), 0.0f, neptuneOrbitRadius * sin(neptuneOrbitSpeed))); // move the planet in a circular path
-        neptuneModel = glm::rotate(neptuneModel, neptuneRotationSpeed, glm::vec3(0.0f, 1.0f, 0.0f)); // rotate the planet around its own y-axis
-
-        neptuneModel = glm::scale(neptuneModel, glm::vec3(0.35f * sizeScale, 0.35f * sizeScale, 0.35f* sizeScale)); // scale down the planet
-        sphereShader.setMat4("model", neptuneModel);
-        glBindTexture(GL_TEXTURE_2D, neptuneTexture);
-        glBindVertexArray(neptuneVAO);
-        glDrawElements(GL_TRIANGLE_STRIP, indexCount, GL_UNSIGNED_INT, 0);
-        
-
-
-        // draw skybox as last
-        glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
-        skyboxShader.use();
-        view = glm::mat4(glm::mat3(camera.GetViewMatrix())); // remove translation from the view matrix
-        skyboxShader.setMat4("view", view);
-        skyboxShader.setMat4("projection", projection);
-        // skybox cube
-        glBindVertexArray(skyboxVAO);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-        glBindVertexArray(0);
-        glDepthFunc(GL_LESS); // set depth function back to default
-
-        // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-        // -------------------------------------------------------------------------------
-        glfwSwapBuffers(window);
-        glfwPollEvents();
-    }
-
- 
+        float simulationTime = TIME_SCALE * currentFrame; // this gives the time in simulation days since the program started
+        if (benchmark)
+            benchmark->apply(frameIndex, simulationTime, camera);
 
+        glm::mat4 view = camera.GetViewMatrix();
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, FAR_PLANE);
+        if (trajectory)
+            trajectory->update(simulationTime);
+
+        // one upload of the per-frame constants for all programs
+        frameUniforms.update(view, projection, camera.Position, currentFrame, simulationTime);
+
+        // Draw the sun and the planets, one multi-draw-indirect call for the whole pass; the command sorts
+        // by the distance to the nearest body's surface
+        float nearestBody = FAR_PLANE;
+        renderer.setFrustum(projection * view);
+        for (unsigned int i = 0; i < BODY_COUNT; i++)
+        {
+            renderer.draw(sphereMesh, BODIES[i].modelMatrix(simulationTime), bodyMaterials[i]);
+            nearestBody = std::min(nearestBody, glm::length(BODIES[i].position(simulationTime) - camera.Position) - BODIES[i].scale);
+        }
+        renderQueue.submit(PASS_OPAQUE, sphereShader.ID, planetTextures, RenderQueue::depthBits(nearestBody, FAR_PLANE), drawBodies, &renderer,
+                           &planetTextures, PHASE_BODIES);
 
-    glfwTerminate();
-    return 0;
-}
-//create a shphere 
-void createSphere(unsigned int& VAO, unsigned int& VBO, unsigned int& EBO) {
-    glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    glGenBuffers(1, &EBO);
+        // Draw the asteroid belt
+        if (nbody)
+        {
+            // advance in fixed steps, on the GPU or on the CPU
+            nbodyAccumulator += deltaTime * TIME_SCALE;
+            unsigned int substeps = std::min((unsigned int)(nbodyAccumulator / NBODY_DT), NBODY_MAX_SUBSTEPS);
+            nbodyAccumulator = substeps == NBODY_MAX_SUBSTEPS ? 0.0f : nbodyAccumulator - substeps * NBODY_DT;
+            for (unsigned int s = 0; s < substeps; s++)
+            {
+                if (nbodyOnGpu)
+                    nbodyGpu->step(NBODY_DT);
+                else
+                    nbody->step(NBODY_DT);
+            }
+            if (!nbodyOnGpu)
+                nbodyGpu->upload(*nbody, frameAllocator);
+
+            // same texture array as the planets, so it sorts next to them; its depth is the distance to the
+            // nearest point of the belt's ring
+            float ring = sqrtf(camera.Position.x * camera.Position.x + camera.Position.z * camera.Position.z);
+            float outside = ring - std::min(std::max(ring, NBODY_BELT_INNER), NBODY_BELT_OUTER);
+            float beltDistance = sqrtf(outside * outside + camera.Position.y * camera.Position.y);
+            renderQueue.submit(PASS_OPAQUE, nbodyShader->ID, planetTextures, RenderQueue::depthBits(beltDistance, FAR_PLANE), drawAsteroids,
+                               nbody.get(), nbodyGpu.get(), PHASE_ASTEROIDS);
+        }
 
+        // draw skybox as last, the sky pass runs after every opaque command
+        if (starField)
+            renderQueue.submit(PASS_SKY, starsShader->ID, 0, 0, drawStars, starField.get(), NULL, PHASE_SKY);
+        else
+            renderQueue.submit(PASS_SKY, skyboxShader.ID, cubemapTexture, 0, drawSkybox, &skyboxVAO, &cubemapTexture, PHASE_SKY);
 
-    std::vector<glm::vec3> positions;
-    std::vector<glm::vec2> uv;
-    std::vector<unsigned int> indices;
+        if (Trace::enabled())
+            Trace::end("simulation");
+        if (profiler)
+            profiler->endPhase(PHASE_SIMULATION);
 
-    const unsigned int X_SEGMENTS = 64;
-    const unsigned int Y_SEGMENTS = 64;
-    const float PI = 3.14159265359;
-    for (unsigned int y = 0; y <= Y_SEGMENTS; ++y)
-    {
-        for (unsigned int x = 0; x <= X_SEGMENTS; ++x)
         {
-            float xSegment = (float)x / (float)X_SEGMENTS;
-            float ySegment = (float)y / (float)Y_SEGMENTS;
-            float xPos = std::cos(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-            float yPos = std::cos(ySegment * PI);
-            float zPos = std::sin(xSegment * 2.0f * PI) * std::sin(ySegment * PI);
-
-            positions.push_back(glm::vec3(xPos, yPos, zPos));
-            uv.push_back(glm::vec2(xSegment, ySegment));
+            TraceScope trace("execute");
+            renderQueue.execute();
         }
-    }
+        if (sunTexture)
+            sunTexture->endFrame();
+        frameAllocator.endFrame();
 
-    bool oddRow = false;
-    for (int y = 0; y < Y_SEGMENTS; ++y)
-    {
-        if (!oddRow) //even rows: y == 0, y == 2; and so on
         {
-            for (int x = 0; x <= X_SEGMENTS; ++x)
+            ProfileScope scope(profiler.get(), PHASE_PRESENT);
+            TraceScope trace("present");
+            if (headless)
             {
-                indices.push_back(y * (X_SEGMENTS + 1) + x);
-                indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
+                if (frameDumper)
+                    frameDumper->capture(frameIndex);
             }
-        }
-        else
-        {
-            for (int x = X_SEGMENTS; x >= 0; --x)
+            else
             {
-                indices.push_back((y + 1) * (X_SEGMENTS + 1) + x);
-                indices.push_back(y * (X_SEGMENTS + 1) + x);
+                // glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+                // -------------------------------------------------------------------------------
+                glfwSwapBuffers(window);
+                glfwPollEvents();
             }
         }
-        oddRow = !oddRow;
-    }
-    indexCount = indices.size();
 
-    std::vector<float> data;
-    for (int i = 0; i < positions.size(); ++i)
-    {
-        data.push_back(positions[i].x);
-        data.push_back(positions[i].y);
-        data.push_back(positions[i].z);
-        if (uv.size() > 0)
+        if (profiler)
+        {
+            profiler->setCounter(COUNTER_STATE_HITS, glState().currentFrameCounters().hits);
+            profiler->setCounter(COUNTER_STATE_MISSES, glState().currentFrameCounters().misses);
+            profiler->setCounter(COUNTER_QUEUE_COMMANDS, renderQueue.lastCommandCount);
+            profiler->setCounter(COUNTER_PROGRAM_CHANGES, renderQueue.lastProgramChanges);
+            profiler->setCounter(COUNTER_ALLOCATOR_BYTES, frameAllocator.lastFrameBytes);
+            profiler->setCounter(COUNTER_ALLOCATOR_STALLS, frameAllocator.stalls - allocatorStalls);
+            profiler->setCounter(COUNTER_UPLOAD_BYTES, gpuMemory().currentFrameUploadBytes());
+            allocatorStalls = frameAllocator.stalls;
+            profiler->endFrame();
+        }
+        if (benchmark)
+            benchmark->record(frameIndex, std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+        frameIndex++;
+
+        // the first frame counts once the GPU has finished it
+        if (startup)
         {
-            data.push_back(uv[i].x);
-            data.push_back(uv[i].y);
+            glFinish();
+            startup->mark("first frame");
+            break;
         }
     }
 
-    glBindVertexArray(VAO);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, data.size() * sizeof(float), &data[0], GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO); 
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    if (headless)
+    {
+        if (frameDumper)
+            frameDumper->flush();
+        glFinish();
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loopStart).count();
+        std::cout << "headless: " << frameIndex << " frames of " << SCR_WIDTH << "x" << SCR_HEIGHT << " in " << seconds << " s, "
+                  << 1000.0 * seconds / std::max(frameIndex, 1u) << " ms per frame (" << glGetString(GL_RENDERER) << ")" << std::endl;
+    }
+    if (benchmark)
+    {
+        glFinish();
+        benchmark->writeResults(benchmarkPath, (const char*)glGetString(GL_RENDERER), SCR_WIDTH, SCR_HEIGHT);
+    }
+    if (profiler)
+    {
+        profiler->finish();
+        profiler->report();
+        profiler->writeCsv(profilePath);
+    }
+    if (memoryReport)
+        gpuMemory().report();
+    if (sunTexture)
+        std::cout << "virtual texture: " << sunTexture->residentPages() << " pages resident, " << (sunTexture->residentBytes() >> 20)
+                  << " MB instead of " << (sunTexture->fullBytes() >> 20) << " MB, " << sunTexture->pagesUploaded << " uploaded, "
+                  << sunTexture->pagesEvicted << " evicted, " << sunTexture->cacheFull << " requests deferred by a full cache" << std::endl;
+    if (tracePath)
+    {
+        trajectory.reset(); // joins the writer thread, so its last chunk is in the trace
+        if (Trace::writeChromeJson(tracePath))
+            std::cout << "trace written to " << tracePath << std::endl;
+    }
+    bool withinBudget = true;
+    if (startup)
+    {
+        startup->print((const char*)glGetString(GL_RENDERER));
+        withinBudget = startup->withinBudget();
+    }
+
+    // the GL objects above are destroyed on return, then GlfwSession terminates GLFW
+    return withinBudget ? 0 : 1;
+}
+// render queue callbacks, the queue has bound the program already
+// ----------------------------------------------------------------
+void drawBodies(void* renderer, void* textures)
+{
+    TraceScope trace("bodies");
+    if (virtualSun)
+        virtualSun->bind();
+    glState().activeTexture(GL_TEXTURE0);
+    glState().bindTexture(GL_TEXTURE_2D_ARRAY, *static_cast<unsigned int*>(textures));
+    static_cast<IndirectRenderer*>(renderer)->flush();
+}
 
-    float stride = (3 + 2) * sizeof(float);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+void drawAsteroids(void* nbody, void* nbodyGpu)
+{
+    TraceScope trace("asteroids");
+    static_cast<NBodyGpu*>(nbodyGpu)->bindPositions();
+    glState().activeTexture(GL_TEXTURE0);
+    glState().bindTexture(GL_TEXTURE_2D_ARRAY, planetTextures);
+    glState().bindVertexArray(asteroidVAO);
+    glDrawElementsInstanced(GL_TRIANGLE_STRIP, asteroidIndexCount, GL_UNSIGNED_INT, 0, static_cast<NBodySystem*>(nbody)->count - BODY_COUNT);
+}
+
+void drawSkybox(void* vertexArray, void* cubemap)
+{
+    TraceScope trace("skybox");
+    glDepthFunc(GL_LEQUAL);  // change depth function so depth test passes when values are equal to depth buffer's content
+    // skybox cube, view and projection come from the Frame block
+    glState().bindVertexArray(*static_cast<unsigned int*>(vertexArray));
+    glState().activeTexture(GL_TEXTURE0);
+    glState().bindTexture(GL_TEXTURE_CUBE_MAP, *static_cast<unsigned int*>(cubemap));
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glDepthFunc(GL_LESS); // set depth function back to default
+}
+
+void drawStars(void* starField, void*)
+{
+    TraceScope trace("stars");
+    static_cast<StarField*>(starField)->draw();
+}
+
+// steps the same N-body system with each backend and prints one machine-readable line per backend.
+// The multi-process CPU backend is measured by NBodyScaling.
+// ---------------------------------------------------------------------------------------------------
+void runNBodyBenchmark(unsigned int particles, unsigned int steps)
+{
+    NBodySystem cpu(particles);
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (unsigned int s = 0; s < steps; s++)
+        cpu.step(NBODY_DT);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "backend=cpu-direct bodies=" << cpu.count << " steps=" << steps << " seconds=" << seconds
+              << " steps_per_second=" << steps / seconds << std::endl;
+
+    NBodySystem initial(particles);
+    NBodyGpu gpu(initial);
+    gpu.step(NBODY_DT); // warm up: first dispatch compiles the pipeline on some drivers
+    glFinish();
+    start = std::chrono::steady_clock::now();
+    for (unsigned int s = 0; s < steps; s++)
+        gpu.step(NBODY_DT);
+    glFinish();
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << "backend=gpu-compute bodies=" << gpu.count << " steps=" << steps << " seconds=" << seconds
+              << " steps_per_second=" << steps / seconds << std::endl;
 }
 
 
@@ -572,6 +838,18 @@ void processInput(GLFWwindow* window)
     else if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
         rotFlg1 = false;
     }
+
+    // write the trace so far, once per key press
+    bool traceKey = glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS;
+    if (tracePath && traceKey && !traceKeyDown && Trace::writeChromeJson(tracePath))
+        std::cout << "trace written to " << tracePath << std::endl;
+    traceKeyDown = traceKey;
+
+    // print the video memory report, once per key press
+    bool memoryKey = glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS;
+    if (memoryKey && !memoryKeyDown)
+        gpuMemory().report();
+    memoryKeyDown = memoryKey;
 }
 
 // glfw: whenever the window size changed (by OS or user resize) this callback function executes
@@ -611,82 +889,3 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset)
 {
     camera.ProcessMouseScroll(static_cast<float>(yoffset));
 }
-
-// utility function for loading a 2D texture from file
-// ---------------------------------------------------
-unsigned int loadTexture(char const* path)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-
-    int width, height, nrComponents;
-    unsigned char* data = stbi_load(path, &width, &height, &nrComponents, 0);
-    if (data)
-    {
-        GLenum format;
-        if (nrComponents == 1)
-            format = GL_RED;
-        else if (nrComponents == 3)
-            format = GL_RGB;
-        else if (nrComponents == 4)
-            format = GL_RGBA;
-
-        glBindTexture(GL_TEXTURE_2D, textureID);
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-        stbi_image_free(data);
-    }
-    else
-    {
-        std::cout << "Texture failed to load at path: " << path << std::endl;
-        stbi_image_free(data);
-    }
-
-    return textureID;
-}
-
-// loads a cubemap texture from 6 individual texture faces
-// order:
-// +X (right)
-// -X (left)
-// +Y (top)
-// -Y (bottom)
-// +Z (front) 
-// -Z (back)
-// -------------------------------------------------------
-unsigned int loadCubemap(vector<std::string> faces)
-{
-    unsigned int textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
-
-    int width, height, nrComponents;
-    for (unsigned int i = 0; i < faces.size(); i++)
-    {
-        unsigned char* data = stbi_load(faces[i].c_str(), &width, &height, &nrComponents, 0);
-        if (data)
-        {
-            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
-        }
-        else
-        {
-            std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);
-        }
-    }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
-
-    return textureID;
-}
-
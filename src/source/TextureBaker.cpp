@@ -0,0 +1,203 @@
+// Bakes textures into GPU block-compressed KTX2 files with their whole mip chain, so SolarSystem uploads them
+// as they are instead of decoding JPG/PNG and generating mipmaps at every start.
+//
+// usage: TextureBaker [--format auto|bc1|bc3|bc7] [--force] [directory...]
+//
+// Every image below the directories (default ../../src/resources/textures, run from bin/bin like SolarSystem)
+// gets a .ktx2 next to it: 2k_earth.jpg -> 2k_earth.ktx2. auto picks BC1 for opaque images and BC3 for images
+// with transparent pixels; bc7 gives the best quality at twice the size of BC1. Images whose .ktx2 is newer
+// are skipped unless --force is given. Images are baked in parallel, one per hardware thread.
+#include <stb_image.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bc_encoder.h"
+#include "ktx2.h"
+#include "texture_loader.h"
+
+enum FormatChoice {
+    FORMAT_AUTO,
+    FORMAT_BC1,
+    FORMAT_BC3,
+    FORMAT_BC7
+};
+
+static bool isImage(const std::string& name)
+{
+    const char* const EXTENSIONS[] = { ".jpg", ".jpeg", ".png", ".tga", ".bmp" };
+    std::string lower = name;
+    std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+    for (unsigned int i = 0; i < sizeof(EXTENSIONS) / sizeof(EXTENSIONS[0]); i++)
+    {
+        size_t length = strlen(EXTENSIONS[i]);
+        if (lower.size() > length && lower.compare(lower.size() - length, length, EXTENSIONS[i]) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void findImages(const std::string& directory, std::vector<std::string>& images)
+{
+    DIR* dir = opendir(directory.c_str());
+    if (!dir)
+    {
+        std::cout << "ERROR::BAKER::DIRECTORY_NOT_FOUND: " << directory << std::endl;
+        return;
+    }
+    while (dirent* entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if (name == "." || name == "..")
+            continue;
+        std::string path = directory + "/" + name;
+        struct stat info;
+        if (stat(path.c_str(), &info) != 0)
+            continue;
+        if (S_ISDIR(info.st_mode))
+            findImages(path, images);
+        else if (S_ISREG(info.st_mode) && isImage(name))
+            images.push_back(path);
+    }
+    closedir(dir);
+    std::sort(images.begin(), images.end());
+}
+
+// true if output exists and is at least as new as source
+static bool upToDate(const std::string& source, const std::string& output)
+{
+    struct stat sourceInfo, outputInfo;
+    return stat(source.c_str(), &sourceInfo) == 0 && stat(output.c_str(), &outputInfo) == 0 &&
+           outputInfo.st_mtime >= sourceInfo.st_mtime;
+}
+
+// compresses every level of the mip chain, each level a box filtered half of the one before
+static bool bake(const std::string& path, FormatChoice choice, std::string& summary)
+{
+    int width, height, nrComponents;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &nrComponents, 4);
+    if (!data)
+    {
+        summary = "failed to load";
+        return false;
+    }
+    bool transparent = false;
+    for (size_t i = 3; i < (size_t)width * height * 4 && !transparent; i += 4)
+        transparent = data[i] < 255;
+    BlockFormat format = choice == FORMAT_BC7 ? BLOCK_BC7 : choice == FORMAT_BC3 || (choice == FORMAT_AUTO && transparent) ? BLOCK_BC3 : BLOCK_BC1;
+    const uint32_t VK_FORMATS[3] = { KTX2_VK_FORMAT_BC1_RGB_UNORM, KTX2_VK_FORMAT_BC3_UNORM, KTX2_VK_FORMAT_BC7_UNORM };
+
+    Ktx2Image image;
+    image.vkFormat = VK_FORMATS[format];
+    image.width = width;
+    image.height = height;
+    std::vector<unsigned char> level(data, data + (size_t)width * height * 4), smaller;
+    stbi_image_free(data);
+    int levelWidth = width, levelHeight = height;
+    for (;;)
+    {
+        image.levels.push_back(std::vector<unsigned char>());
+        compressImage(format, &level[0], levelWidth, levelHeight, image.levels.back());
+        if (levelWidth == 1 && levelHeight == 1)
+            break;
+        int nextWidth = std::max(levelWidth / 2, 1), nextHeight = std::max(levelHeight / 2, 1);
+        smaller.resize((size_t)nextWidth * nextHeight * 4);
+        resampleImage(&level[0], levelWidth, levelHeight, &smaller[0], nextWidth, nextHeight, 4);
+        level.swap(smaller);
+        levelWidth = nextWidth;
+        levelHeight = nextHeight;
+    }
+    if (!writeKtx2(ktx2Path(path), image))
+    {
+        summary = "failed to write";
+        return false;
+    }
+
+    size_t bytes = 0;
+    for (unsigned int i = 0; i < image.levels.size(); i++)
+        bytes += image.levels[i].size();
+    // what the GPU held before: RGB or RGBA8 plus a third for the generated mipmaps
+    double uncompressed = (double)width * height * (transparent ? 4 : 3) * 4.0 / 3.0;
+    const char* const NAMES[3] = { "bc1", "bc3", "bc7" };
+    char text[160];
+    std::snprintf(text, sizeof(text), "%s %dx%d, %u levels, %.1f MB -> %.1f MB (%.1fx)", NAMES[format], width, height,
+                  (unsigned int)image.levels.size(), uncompressed / (1 << 20), bytes / (double)(1 << 20), uncompressed / bytes);
+    summary = text;
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    FormatChoice format = FORMAT_AUTO;
+    bool force = false;
+    std::vector<std::string> directories;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+        {
+            std::string name = argv[++i];
+            if (name == "bc1")
+                format = FORMAT_BC1;
+            else if (name == "bc3")
+                format = FORMAT_BC3;
+            else if (name == "bc7")
+                format = FORMAT_BC7;
+            else if (name != "auto")
+            {
+                std::cout << "ERROR::BAKER::UNKNOWN_FORMAT: " << name << ", expected auto, bc1, bc3 or bc7" << std::endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--force") == 0)
+            force = true;
+        else
+            directories.push_back(argv[i]);
+    }
+    if (directories.empty())
+        directories.push_back("../../src/resources/textures");
+
+    std::vector<std::string> images;
+    for (unsigned int i = 0; i < directories.size(); i++)
+        findImages(directories[i], images);
+    std::vector<std::string> pending;
+    for (unsigned int i = 0; i < images.size(); i++)
+        if (force || !upToDate(images[i], ktx2Path(images[i])))
+            pending.push_back(images[i]);
+    std::printf("%u images, %u to bake\n", (unsigned int)images.size(), (unsigned int)pending.size());
+
+    std::atomic<unsigned int> next(0);
+    std::atomic<unsigned int> failures(0);
+    std::mutex output;
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    unsigned int threads = std::min(std::max(std::thread::hardware_concurrency(), 1u), (unsigned int)pending.size());
+    for (unsigned int t = 0; t < threads; t++)
+        workers.push_back(std::thread([&]() {
+            for (unsigned int i; (i = next++) < pending.size();)
+            {
+                std::chrono::steady_clock::time_point imageStart = std::chrono::steady_clock::now();
+                std::string summary;
+                if (!bake(pending[i], format, summary))
+                    failures++;
+                double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - imageStart).count();
+                std::lock_guard<std::mutex> lock(output);
+                std::printf("%s: %s, %.2f s\n", pending[i].c_str(), summary.c_str(), seconds);
+            }
+        }));
+    for (unsigned int t = 0; t < workers.size(); t++)
+        workers[t].join();
+    std::printf("baked %u images in %.2f s, %u failed\n", (unsigned int)pending.size() - failures.load(),
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count(), failures.load());
+    return failures > 0 ? 1 : 0;
+}